@@ -1,10 +1,14 @@
+#define _GNU_SOURCE /* for pthread_attr_setaffinity_np */
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h> /* for gettimeofday system call */
+#include <sys/resource.h> /* for getrusage system call */
+#include <sched.h>
 #include "../src/lab.h"
 
 #define UNUSED(x) (void)x
@@ -13,6 +17,27 @@
 #define MAX_SLEEP 1000000 /* maximum time a thread can sleep in nanoseconds*/
 
 static bool delay = false;
+static int batch = 1; /*items moved per enqueue_batch/dequeue_batch call*/
+static bool utilization = false; /*report how busy each consumer was*/
+static bool inline_items = false; /*copy ints into a sized queue instead of malloc'ing them*/
+static size_t max_bytes = 0; /*byte budget for the queue, 0 bounds it by count only*/
+
+/*Per consumer accounting for the -u utilization report*/
+static struct consumer_stats
+{
+     unsigned int items; /*items this consumer took off the queue*/
+     double blocked;     /*milliseconds spent inside dequeue/dequeue_batch*/
+     double lifetime;    /*milliseconds from thread start to exit*/
+} cstats[MAX_C];
+
+/*Total user plus system CPU time of the process in milliseconds*/
+static double getCpuMilliSeconds()
+{
+     struct rusage ru;
+     getrusage(RUSAGE_SELF, &ru);
+     return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+            (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
 
 double getMilliSeconds()
 {
@@ -32,6 +57,47 @@ static struct
 /*Shared queue that producers and consumers will access*/
 static queue_t pc_queue;
 
+/*Frees items the -O overflow policy pushed out of the queue*/
+static void free_evicted(void *item, void *arg)
+{
+     (void)arg;
+     if (!inline_items)
+          free(item);
+}
+
+/**
+ * Fills set with the CPUs of a NUMA node, as listed in sysfs
+ * (e.g. "0-3,8-11"). Returns false if the node does not exist.
+ */
+static bool node_cpus(int node, cpu_set_t *set)
+{
+     char path[64];
+     int lo, hi;
+     char sep;
+     snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+     CPU_ZERO(set);
+     FILE *f = fopen(path, "r");
+     if (f == NULL)
+          return false;
+     while (fscanf(f, "%d", &lo) == 1)
+     {
+          hi = lo;
+          if (fscanf(f, "%c", &sep) == 1 && sep == '-')
+          {
+               if (fscanf(f, "%d", &hi) != 1)
+                    break;
+               if (fscanf(f, "%c", &sep) != 1)
+                    sep = '\n';
+          }
+          for (int cpu = lo; cpu <= hi; cpu++)
+               CPU_SET(cpu, set);
+          if (sep != ',')
+               break;
+     }
+     fclose(f);
+     return CPU_COUNT(set) > 0;
+}
+
 /**
  * Produces items at a random interval. Exits once it has produced
  * the correct number of items.
@@ -55,10 +121,25 @@ static void *producer(void *args)
                nanosleep(&s, NULL);
           }
 
-          itm = (int *)malloc(sizeof(int));
-          *itm = i;
-          // Put the item into the queue
-          enqueue(pc_queue, itm);
+          if (inline_items)
+          {
+               // Copy the item straight into the queue's slot array
+               if (enqueue_copy(pc_queue, &i) != QUEUE_OK)
+                    continue;
+          }
+          else
+          {
+               itm = (int *)malloc(sizeof(int));
+               *itm = i;
+               // Put the item into the queue; -O reject may turn it away.
+               // With -B each item stands for a payload of 64 B to 4 KiB.
+               size_t bytes = max_bytes > 0 ? (size_t)64 << (i % 7) : 0;
+               if (enqueue_bytes(pc_queue, itm, bytes, NULL) != QUEUE_OK)
+               {
+                    free(itm);
+                    continue;
+               }
+          }
 
           // Update counters for testing purposes
           pthread_mutex_lock(&numproduced.lock);
@@ -74,11 +155,13 @@ static void *producer(void *args)
  */
 static void *consumer(void *args)
 {
-     UNUSED(args);
+     struct consumer_stats *st = args;
+     double born = utilization ? getMilliSeconds() : 0;
      //pthread_t tid = pthread_self();
      unsigned int seedp = 0;
      struct timespec s = {0, 0};
      int *itm = NULL;
+     int value = 0;
      // fprintf(stderr, "Consumer thread: %ld\n", tid);
 
      while (true)
@@ -90,10 +173,18 @@ static void *consumer(void *args)
                nanosleep(&s, NULL);
           }
 
-          itm = (int *)dequeue(pc_queue);
+          double t0 = utilization ? getMilliSeconds() : 0;
+          if (inline_items)
+               itm = dequeue_copy(pc_queue, &value) == QUEUE_OK ? &value : NULL;
+          else
+               itm = (int *)dequeue(pc_queue);
+          if (utilization)
+               st->blocked += getMilliSeconds() - t0;
           if (itm)
           {
-               free(itm);
+               st->items++;
+               if (!inline_items)
+                    free(itm);
                itm = NULL;
                // Update counters for testing purposes
                pthread_mutex_lock(&numconsumed.lock);
@@ -114,13 +205,136 @@ static void *consumer(void *args)
           }
      }
      // fprintf(stderr, "Consumer Thread: %ld - Done consuming!\n", tid);
+     if (utilization)
+          st->lifetime = getMilliSeconds() - born;
+     pthread_exit(NULL);
+}
+
+/**
+ * Produces items like producer() but hands them to the queue in runs of
+ * batch items with enqueue_batch.
+ */
+static void *batch_producer(void *args)
+{
+     int num = *((int *)args);
+     unsigned int seedp = 0;
+     struct timespec s = {0, 0};
+     void **pending = malloc(sizeof(void *) * batch);
+     int npending = 0;
+
+     for (int i = 0; i < num; i++)
+     {
+          if (delay)
+          {
+               /*simulate producing the item*/
+               s.tv_nsec = (rand_r(&seedp) % MAX_SLEEP);
+               nanosleep(&s, NULL);
+          }
+
+          int *itm = (int *)malloc(sizeof(int));
+          *itm = i;
+          pending[npending++] = itm;
+          if (npending < batch && i < num - 1)
+               continue;
+
+          // Put the whole run into the queue
+          int added = enqueue_batch(pc_queue, pending, npending);
+          for (int k = added; k < npending; k++)
+               free(pending[k]);
+
+          // Update counters for testing purposes
+          pthread_mutex_lock(&numproduced.lock);
+          numproduced.num += added;
+          pthread_mutex_unlock(&numproduced.lock);
+          npending = 0;
+     }
+     free(pending);
+     pthread_exit(NULL);
+}
+
+/**
+ * Consumes items up to batch at a time with dequeue_batch.
+ */
+static void *batch_consumer(void *args)
+{
+     struct consumer_stats *st = args;
+     double born = utilization ? getMilliSeconds() : 0;
+     unsigned int seedp = 0;
+     struct timespec s = {0, 0};
+     void **items = malloc(sizeof(void *) * batch);
+
+     while (true)
+     {
+          if (delay)
+          {
+               /*simulate consuming the items*/
+               s.tv_nsec = (rand_r(&seedp) % MAX_SLEEP);
+               nanosleep(&s, NULL);
+          }
+
+          double t0 = utilization ? getMilliSeconds() : 0;
+          int got = dequeue_batch(pc_queue, items, batch, 1);
+          if (utilization)
+               st->blocked += getMilliSeconds() - t0;
+          st->items += got;
+          if (got == 0)
+          {
+               // Like consumer(), an empty result is only valid after shutdown.
+               if (!is_shutdown(pc_queue))
+               {
+                    fprintf(stderr, "ERROR: Got no items when queue was not shutdown!\n");
+               }
+               break;
+          }
+          for (int i = 0; i < got; i++)
+               free(items[i]);
+          // Update counters for testing purposes
+          pthread_mutex_lock(&numconsumed.lock);
+          numconsumed.num += got;
+          pthread_mutex_unlock(&numconsumed.lock);
+     }
+     free(items);
+     if (utilization)
+          st->lifetime = getMilliSeconds() - born;
      pthread_exit(NULL);
 }
 
+/**
+ * Prints how many items each consumer handled and which fraction of its
+ * lifetime it spent outside the queue, i.e. doing useful work.
+ */
+static void report_utilization(int numc)
+{
+     double sum = 0;
+     for (int i = 0; i < numc; i++)
+     {
+          double busy = cstats[i].lifetime > 0 ? 1.0 - cstats[i].blocked / cstats[i].lifetime : 0;
+          sum += busy;
+          fprintf(stderr, "Consumer %d: %u items, %.1f%% busy\n", i, cstats[i].items, busy * 100.0);
+     }
+     fprintf(stderr, "Mean consumer utilization: %.1f%%\n", numc > 0 ? sum / numc * 100.0 : 0);
+}
+
 static void usage(char *n)
 {
-     fprintf(stderr, "Usage: %s [-c num consumer] [-p num producer] [-i num items] [-s queue size] <-d introduce delay>\n", n);
-     fprintf(stderr, "-d will introduce a random delay between consumer and producer");
+     fprintf(stderr, "Usage: %s [-c num consumer] [-p num producer] [-i num items] [-s queue size] [-m mode] [-w wait] [-b batch] [-S spin,yield] <-A adaptive spin> <-P power-of-two size> <-I inline items> [-N producer node,consumer node] [-L bind|interleave] <-H huge pages> [-O overflow] [-B max bytes] [-C cached segments] <-q queue stats> [-n queue name] <-d introduce delay> <-u report consumer utilization>\n", n);
+     fprintf(stderr, "-d will introduce a random delay between consumer and producer\n");
+     fprintf(stderr, "-u reports per consumer item counts and the share of time spent outside dequeue\n");
+     fprintf(stderr, "-w selects how the lock and unbounded backends park blocked threads: cond (default) or futex\n");
+     fprintf(stderr, "-S spins up to spin times, then yields up to yield times, before a blocked thread parks\n");
+     fprintf(stderr, "-A adapts the spin budget (up to the -S spin limit) from how recent waits ended\n");
+     fprintf(stderr, "-P rounds the queue size up to a power of two so slots are indexed with a mask\n");
+     fprintf(stderr, "-I copies int items into a sized queue instead of malloc'ing each one (lock mode, no -b)\n");
+     fprintf(stderr, "-N pins producers and consumers to the CPUs of the given NUMA nodes\n");
+     fprintf(stderr, "-L binds the queue buffer to the consumer node or interleaves it across nodes\n");
+     fprintf(stderr, "-H backs the queue buffer with transparent huge pages\n");
+     fprintf(stderr, "-O selects what a full queue does: block (default), reject, evict, or overwrite (mpmc only)\n");
+     fprintf(stderr, "-B also bounds the queue by the bytes of its items, which cycle from 64 B to 4 KiB (lock mode, no -I or -b)\n");
+     fprintf(stderr, "-C keeps up to that many drained segments of an unbounded queue for reuse (default 4)\n");
+     fprintf(stderr, "-q keeps queue stats and reports waits, peak occupancy and time in queue (not compact, unbounded or overwrite)\n");
+     fprintf(stderr, "-n publishes the queue's stats under name for queuetop (implies -q)\n");
+     fprintf(stderr, "-b moves items in runs of batch with enqueue_batch/dequeue_batch\n");
+     fprintf(stderr, "-m selects the queue backend: lock (default), mpmc, compact, unbounded (ignores -s), or spsc (forces -p 1 -c 1)\n");
      exit(EXIT_FAILURE);
 }
 
@@ -130,12 +344,26 @@ int main(int argc, char *argv[])
      int numc = 1;       /*total number of consumers*/
      int numitems = 10;  /*total number of items to produce per thread*/
      int queue_size = 5; /*The default size of the queue*/
+     const char *mode = "lock"; /*The queue backend to benchmark*/
+     const char *wait = "cond"; /*How the lock backend parks blocked threads*/
+     bool pow2 = false;  /*Round the queue size up to a power of two*/
+     int pnode = -1, cnode = -1; /*NUMA nodes to pin producers/consumers to*/
+     queue_placement_t placement = {false, QUEUE_NUMA_DEFAULT, 0}; /*Where the buffer lives*/
+     pthread_attr_t pattr, cattr;
+     cpu_set_t cpus;
+     queue_wait_strategy_t strategy = {0, 0, false}; /*Spin/yield before parking*/
+     queue_overflow_t overflow = QUEUE_OVERFLOW_BLOCK; /*What a full queue does*/
+     queue_stats_t qstats;
+     bool keep_stats = false; /*Keep counters for queue_stats_snapshot*/
+     const char *name = NULL; /*Publish the counters for queuetop under this name*/
+     int segment_cache = -1; /*Drained segments an unbounded queue keeps, -1 for the default*/
+     queue_snapshot_t snap;
      int c;
 
      pthread_t producers[MAX_P];
      pthread_t consumers[MAX_C];
 
-     while ((c = getopt(argc, argv, "c:p:i:s:dh")) != -1)
+     while ((c = getopt(argc, argv, "c:p:i:s:m:b:w:S:APIN:L:HO:B:C:qn:duh")) != -1)
           switch (c)
           {
           case 'c':
@@ -151,9 +379,74 @@ int main(int argc, char *argv[])
           case 's':
                queue_size = atoi(optarg);
                break;
+          case 'm':
+               mode = optarg;
+               break;
+          case 'b':
+               batch = atoi(optarg);
+               break;
+          case 'w':
+               wait = optarg;
+               break;
+          case 'S':
+               if (sscanf(optarg, "%d,%d", &strategy.spin, &strategy.yield) < 1)
+                    usage(argv[0]);
+               break;
+          case 'A':
+               strategy.adaptive = true;
+               break;
+          case 'P':
+               pow2 = true;
+               break;
+          case 'I':
+               inline_items = true;
+               break;
+          case 'N':
+               if (sscanf(optarg, "%d,%d", &pnode, &cnode) != 2)
+                    usage(argv[0]);
+               break;
+          case 'L':
+               if (strcmp(optarg, "bind") == 0)
+                    placement.policy = QUEUE_NUMA_BIND;
+               else if (strcmp(optarg, "interleave") == 0)
+                    placement.policy = QUEUE_NUMA_INTERLEAVE;
+               else
+                    usage(argv[0]);
+               break;
+          case 'H':
+               placement.huge_pages = true;
+               break;
+          case 'O':
+               if (strcmp(optarg, "block") == 0)
+                    overflow = QUEUE_OVERFLOW_BLOCK;
+               else if (strcmp(optarg, "reject") == 0)
+                    overflow = QUEUE_OVERFLOW_REJECT;
+               else if (strcmp(optarg, "evict") == 0)
+                    overflow = QUEUE_OVERFLOW_EVICT;
+               else if (strcmp(optarg, "overwrite") == 0)
+                    overflow = QUEUE_OVERFLOW_OVERWRITE;
+               else
+                    usage(argv[0]);
+               break;
+          case 'B':
+               max_bytes = strtoul(optarg, NULL, 10);
+               break;
+          case 'C':
+               segment_cache = atoi(optarg);
+               break;
+          case 'q':
+               keep_stats = true;
+               break;
+          case 'n':
+               name = optarg;
+               keep_stats = true;
+               break;
           case 'd':
                delay = true;
                break;
+          case 'u':
+               utilization = true;
+               break;
           case 'h':
                usage(argv[0]);
                break;
@@ -164,26 +457,108 @@ int main(int argc, char *argv[])
           numc = MAX_C;
      if (nump > MAX_P)
           nump = MAX_P;
+     if (batch < 1)
+          batch = 1;
+     if (strcmp(mode, "spsc") == 0)
+     {
+          /*The SPSC ring only supports one thread on each side*/
+          nump = 1;
+          numc = 1;
+     }
+     else if (strcmp(mode, "lock") != 0 && strcmp(mode, "mpmc") != 0 && strcmp(mode, "compact") != 0 &&
+              strcmp(mode, "unbounded") != 0)
+     {
+          usage(argv[0]);
+     }
+     if (strcmp(wait, "cond") != 0 && strcmp(wait, "futex") != 0)
+          usage(argv[0]);
+     if (inline_items && (strcmp(mode, "lock") != 0 || batch > 1))
+          usage(argv[0]);
+     if (strcmp(wait, "futex") == 0 && strcmp(mode, "lock") != 0 && strcmp(mode, "unbounded") != 0)
+          usage(argv[0]);
+     if (max_bytes > 0 && (strcmp(mode, "lock") != 0 || inline_items || batch > 1))
+          usage(argv[0]);
+     if (keep_stats && (strcmp(mode, "compact") == 0 || strcmp(mode, "unbounded") == 0 ||
+                        overflow == QUEUE_OVERFLOW_OVERWRITE))
+          usage(argv[0]);
+     if (placement.policy == QUEUE_NUMA_BIND && cnode < 0)
+          usage(argv[0]);
+     placement.node = cnode;
+
+     /*Thread attributes carry the CPU pinning for each side*/
+     pthread_attr_init(&pattr);
+     pthread_attr_init(&cattr);
+     if (pnode >= 0)
+     {
+          bool known = node_cpus(pnode, &cpus);
+          pthread_attr_setaffinity_np(&pattr, sizeof(cpus), &cpus);
+          known = known && node_cpus(cnode, &cpus);
+          pthread_attr_setaffinity_np(&cattr, sizeof(cpus), &cpus);
+          if (!known)
+          {
+               fprintf(stderr, "Unknown NUMA node in -N %d,%d\n", pnode, cnode);
+               exit(EXIT_FAILURE);
+          }
+          fprintf(stderr, "Pinning producers to node %d and consumers to node %d\n", pnode, cnode);
+     }
+
+     /*Every flag that shapes the queue goes into one set of attributes*/
+     queue_attr_t qattr;
+     queue_attr_init(&qattr);
+     if (queue_attr_setcapacity(&qattr, queue_size) != 0 ||
+         queue_attr_setwaitstrategy(&qattr, &strategy) != 0)
+          usage(argv[0]);
+     if (strcmp(mode, "spsc") == 0)
+          queue_attr_setbackend(&qattr, QUEUE_BACKEND_SPSC);
+     else if (strcmp(mode, "mpmc") == 0)
+          queue_attr_setbackend(&qattr, QUEUE_BACKEND_MPMC);
+     else if (strcmp(mode, "compact") == 0)
+          queue_attr_setbackend(&qattr, QUEUE_BACKEND_COMPACT);
+     else if (strcmp(mode, "unbounded") == 0)
+          queue_attr_setbackend(&qattr, QUEUE_BACKEND_UNBOUNDED);
+     if (segment_cache >= 0 && queue_attr_setsegmentcache(&qattr, segment_cache) != 0)
+          usage(argv[0]);
+     if (strcmp(wait, "futex") == 0)
+          queue_attr_setparking(&qattr, QUEUE_PARK_FUTEX);
+     if (inline_items)
+          queue_attr_setelemsize(&qattr, sizeof(int));
+     queue_attr_setpow2(&qattr, pow2);
+     queue_attr_setplacement(&qattr, &placement);
+     queue_attr_setoverflow(&qattr, overflow, free_evicted, NULL);
+     queue_attr_setmaxbytes(&qattr, max_bytes);
+     queue_attr_setstats(&qattr, keep_stats);
+     if (queue_attr_setname(&qattr, name) != 0)
+          usage(argv[0]);
+     if (pow2)
+          queue_size = queue_pow2_capacity(queue_size);
 
      int per_thread = numitems / nump;
-     fprintf(stderr, "Simulating %d producers %d consumers with %d items per thread and a queue size of %d\n", nump, numc, per_thread, queue_size);
+     fprintf(stderr, "Simulating %d producers %d consumers with %d items per thread and a queue size of %d (%s/%s%s, batch %d, spin %d%s, yield %d)\n", nump, numc, per_thread, queue_size, mode, wait, inline_items ? "/inline" : "", batch,
+             strategy.spin, strategy.adaptive ? " adaptive" : "", strategy.yield);
      // Start our timing
      double end = 0;
      double start = getMilliSeconds();
+     double cpu_start = getCpuMilliSeconds();
 
      // Initialize the queue for usage
-     pc_queue = queue_init(queue_size);
+     pc_queue = queue_init_attr(&qattr);
+     queue_attr_destroy(&qattr);
+     if (pc_queue == NULL)
+     {
+          fprintf(stderr, "ERROR: could not create the queue\n");
+          exit(EXIT_FAILURE);
+     }
      /*Create the producer threads*/
      for (int i = 0; i < nump; i++)
      {
-          pthread_create(&producers[i], NULL, producer, (void *)&per_thread);
+          pthread_create(&producers[i], &pattr, batch > 1 ? batch_producer : producer, (void *)&per_thread);
      }
 
      fprintf(stderr, "Creating %d consumer threads\n", numc);
      /*Create the consumer threads*/
      for (int i = 0; i < numc; i++)
      {
-          pthread_create(&consumers[i], NULL, consumer, (void *)NULL);
+          pthread_create(&consumers[i], &cattr, batch > 1 ? batch_consumer : consumer, (void *)&cstats[i]);
      }
 
      /*Wait for all the the producer threads to finish*/
@@ -203,7 +578,9 @@ int main(int argc, char *argv[])
           pthread_join(consumers[i], NULL);
      }
 
-     if (numproduced.num != numconsumed.num)
+     /*Items the overflow policy evicted were produced but never consumed*/
+     queue_stats(pc_queue, &qstats);
+     if (numproduced.num != numconsumed.num + qstats.evicted)
      {
           fprintf(stderr, "ERROR! produced != consumed\n");
           abort();
@@ -211,12 +588,35 @@ int main(int argc, char *argv[])
      fprintf(stderr, "Queue is empty:%s\n", is_empty(pc_queue) ? "true" : "false");
      fprintf(stderr, "Total produced:%d\n", numproduced.num);
      fprintf(stderr, "Total consumed:%d\n", numconsumed.num);
+     if (qstats.rejected > 0 || qstats.evicted > 0)
+          fprintf(stderr, "Rejected:%zu Evicted:%zu\n", qstats.rejected, qstats.evicted);
+     if (max_bytes > 0)
+          fprintf(stderr, "Peak bytes queued:%zu of %zu\n", qstats.peak_bytes, max_bytes);
+     if (strcmp(mode, "unbounded") == 0)
+          fprintf(stderr, "Segment memory left:%zu bytes\n", qstats.ring_bytes);
+     if (queue_stats_snapshot(pc_queue, &snap))
+     {
+          fprintf(stderr, "Waits: %zu full (%.3f ms), %zu empty (%.3f ms), peak occupancy %d\n",
+                  snap.full_waits, snap.enqueue_wait_ns / 1e6, snap.empty_waits, snap.dequeue_wait_ns / 1e6,
+                  snap.peak_count);
+          fprintf(stderr, "Time in queue: p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+                  queue_latency_percentile(&snap, 50), queue_latency_percentile(&snap, 99),
+                  queue_latency_percentile(&snap, 99.9), queue_latency_percentile(&snap, 100));
+     }
+     if (utilization)
+          report_utilization(numc);
 
      // Free up all the stuff we allocated
      queue_destroy(pc_queue);
+     pthread_attr_destroy(&pattr);
+     pthread_attr_destroy(&cattr);
 
      // End our timing
      end = getMilliSeconds();
+     double cpu = getCpuMilliSeconds() - cpu_start;
+     if (numproduced.num > 0)
+          fprintf(stderr, "Throughput: %.0f items/s, CPU time: %.1f ns/item\n",
+                  numproduced.num / ((end - start) / 1000.0), cpu * 1e6 / numproduced.num);
      // Print timing to standard out to graph
      fprintf(stdout, " %f %d \n", end - start, numproduced.num);
 
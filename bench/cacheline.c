@@ -0,0 +1,153 @@
+/**
+ * @file cacheline.c
+ * @brief Measures cross-core cache traffic between one producer and one
+ *        consumer. Build with `make bench` and compare bench-cacheline with
+ *        bench-cacheline-packed, the same program linked against a queue
+ *        built with -DQUEUE_PACKED_LAYOUT.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../src/lab.h"
+
+#define DEFAULT_ITEMS 2000000
+#define QUEUE_SIZE 1024
+
+static queue_t queue;
+static long items = DEFAULT_ITEMS;
+static int ncpus;
+
+/*Hardware events counted for the whole process, child threads included*/
+static struct
+{
+     const char *name;
+     uint32_t type;
+     uint64_t config;
+     int fd;
+} events[] = {
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1},
+    {"L1d-load-misses", PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+     -1},
+};
+#define NEVENTS (sizeof(events) / sizeof(events[0]))
+
+static int perf_open(uint32_t type, uint64_t config)
+{
+     struct perf_event_attr attr;
+     memset(&attr, 0, sizeof(attr));
+     attr.size = sizeof(attr);
+     attr.type = type;
+     attr.config = config;
+     attr.disabled = 1;
+     attr.inherit = 1;
+     attr.exclude_kernel = 1;
+     attr.exclude_hv = 1;
+     return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now_ns(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*Keep the two sides on different cores when there is more than one*/
+static void pin(int cpu)
+{
+     if (ncpus < 2)
+          return;
+     cpu_set_t set;
+     CPU_ZERO(&set);
+     CPU_SET(cpu % ncpus, &set);
+     pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *producer(void *arg)
+{
+     (void)arg;
+     pin(0);
+     for (long i = 1; i <= items; i++)
+          enqueue(queue, (void *)(intptr_t)i);
+     return NULL;
+}
+
+static void *consumer(void *arg)
+{
+     long *sum = arg;
+     void *item;
+     pin(1);
+     while ((item = dequeue(queue)) != NULL)
+          *sum += (intptr_t)item;
+     return NULL;
+}
+
+static void run(const char *name, queue_t (*init)(int))
+{
+     pthread_t p, c;
+     long sum = 0;
+     queue = init(QUEUE_SIZE);
+     for (size_t i = 0; i < NEVENTS; i++)
+          if (events[i].fd >= 0)
+          {
+               ioctl(events[i].fd, PERF_EVENT_IOC_RESET, 0);
+               ioctl(events[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+          }
+     double start = now_ns();
+     pthread_create(&c, NULL, consumer, &sum);
+     pthread_create(&p, NULL, producer, NULL);
+     pthread_join(p, NULL);
+     queue_shutdown(queue);
+     pthread_join(c, NULL);
+     double elapsed = now_ns() - start;
+     printf("%-6s %8.1f ns/item", name, elapsed / items);
+     for (size_t i = 0; i < NEVENTS; i++)
+     {
+          uint64_t count = 0;
+          if (events[i].fd < 0 ||
+              ioctl(events[i].fd, PERF_EVENT_IOC_DISABLE, 0) != 0 ||
+              read(events[i].fd, &count, sizeof(count)) != sizeof(count))
+               printf("  %s n/a", events[i].name);
+          else
+               printf("  %s %.3f/item", events[i].name, (double)count / items);
+     }
+     printf("\n");
+     if (sum != items * (items + 1) / 2)
+     {
+          fprintf(stderr, "ERROR: %s lost items\n", name);
+          exit(EXIT_FAILURE);
+     }
+     queue_destroy(queue);
+}
+
+int main(int argc, char *argv[])
+{
+     if (argc > 1)
+          items = atol(argv[1]);
+     if (items <= 0)
+          items = DEFAULT_ITEMS;
+     ncpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+     for (size_t i = 0; i < NEVENTS; i++)
+          events[i].fd = perf_open(events[i].type, events[i].config);
+     if (events[0].fd < 0)
+          fprintf(stderr, "perf_event_open unavailable; reporting time only\n");
+     printf("%ld items, queue size %d, %d cpus\n", items, QUEUE_SIZE, ncpus);
+     run("lock", queue_init);
+     run("spsc", queue_init_spsc);
+     run("mpmc", queue_init_mpmc);
+     for (size_t i = 0; i < NEVENTS; i++)
+          if (events[i].fd >= 0)
+               close(events[i].fd);
+     return 0;
+}
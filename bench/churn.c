@@ -0,0 +1,75 @@
+/**
+ * @file churn.c
+ * @brief Creates, uses once and destroys short-lived queues in a tight
+ *        loop, comparing heap-allocated queues (queue_init) with queues
+ *        built in one reused arena block (queue_init_in_place).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "../src/lab.h"
+
+#define DEFAULT_ROUNDS 1000000
+#define REPEATS 5
+#define CAPACITY 16
+
+static double now_ns(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*One fan-out's worth of work: a single item through the queue*/
+static void use(queue_t q)
+{
+     if (q == NULL)
+     {
+          fprintf(stderr, "ERROR: queue creation failed\n");
+          exit(EXIT_FAILURE);
+     }
+     enqueue(q, (void *)(intptr_t)1);
+     if (dequeue(q) == NULL)
+     {
+          fprintf(stderr, "ERROR: dequeue returned NULL\n");
+          exit(EXIT_FAILURE);
+     }
+     queue_destroy(q);
+}
+
+/**
+ * Runs rounds create/use/destroy cycles, with arena set building every
+ * queue in it. Returns the best of REPEATS runs in nanoseconds per cycle.
+ */
+static double measure(long rounds, void *arena, size_t size)
+{
+     double best = 0;
+     for (int r = 0; r < REPEATS; r++)
+     {
+          double start = now_ns();
+          for (long i = 0; i < rounds; i++)
+               use(arena != NULL ? queue_init_in_place(arena, size, CAPACITY) : queue_init(CAPACITY));
+          double ns = (now_ns() - start) / rounds;
+          if (r == 0 || ns < best)
+               best = ns;
+     }
+     return best;
+}
+
+int main(int argc, char *argv[])
+{
+     long rounds = argc > 1 ? atol(argv[1]) : DEFAULT_ROUNDS;
+     if (rounds <= 0)
+          rounds = DEFAULT_ROUNDS;
+     size_t size = queue_required_size(CAPACITY);
+     void *arena = malloc(size);
+     if (arena == NULL)
+          return EXIT_FAILURE;
+     printf("%ld create/use/destroy cycles, capacity %d, best of %d\n", rounds, CAPACITY, REPEATS);
+     printf("%-9s %8.1f ns/cycle\n", "heap", measure(rounds, NULL, 0));
+     printf("%-9s %8.1f ns/cycle (%zu bytes)\n", "in-place", measure(rounds, arena, size), size);
+     free(arena);
+     return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file latency.c
+ * @brief Single-threaded per-operation latency of enqueue/dequeue on every
+ *        backend, comparing a capacity that needs a division to wrap with
+ *        the next power of two, which is indexed with a mask.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "../src/lab.h"
+
+#define DEFAULT_OPS 5000000
+#define ROUNDS 5
+#define CAPACITY 1000
+
+static double now_ns(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Keeps the queue half full and times ops enqueue+dequeue pairs. Returns
+ * the best of ROUNDS runs in nanoseconds per single operation.
+ */
+static double measure(queue_t (*init)(int), int capacity, long ops)
+{
+     queue_t q = init(capacity);
+     double best = 0;
+     for (int i = 0; i < capacity / 2; i++)
+          enqueue(q, (void *)(intptr_t)(i + 1));
+     for (int r = 0; r < ROUNDS; r++)
+     {
+          double start = now_ns();
+          for (long i = 0; i < ops; i++)
+          {
+               enqueue(q, (void *)(intptr_t)(i + 1));
+               if (dequeue(q) == NULL)
+               {
+                    fprintf(stderr, "ERROR: dequeue returned NULL\n");
+                    exit(EXIT_FAILURE);
+               }
+          }
+          double ns = (now_ns() - start) / (2.0 * ops);
+          if (r == 0 || ns < best)
+               best = ns;
+     }
+     queue_destroy(q);
+     return best;
+}
+
+int main(int argc, char *argv[])
+{
+     long ops = argc > 1 ? atol(argv[1]) : DEFAULT_OPS;
+     if (ops <= 0)
+          ops = DEFAULT_OPS;
+     static const struct
+     {
+          const char *name;
+          queue_t (*init)(int);
+     } backends[] = {
+         {"lock", queue_init},
+         {"futex", queue_init_futex},
+         {"spsc", queue_init_spsc},
+         {"mpmc", queue_init_mpmc},
+     };
+     int pow2 = queue_pow2_capacity(CAPACITY);
+     printf("%ld ops, best of %d, ns/op\n", ops, ROUNDS);
+     printf("%-6s %10s %10s\n", "", "cap", "cap");
+     printf("%-6s %10d %10d\n", "", CAPACITY, pow2);
+     for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+     {
+          double mod = measure(backends[i].init, CAPACITY, ops);
+          double mask = measure(backends[i].init, pow2, ops);
+          printf("%-6s %10.2f %10.2f\n", backends[i].name, mod, mask);
+     }
+     return 0;
+}
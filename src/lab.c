@@ -5,172 +5,5209 @@
  */
 
 #include <pthread.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <linux/futex.h>
+#include <linux/memfd.h>
+#include <linux/mempolicy.h>
+#include <time.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <assert.h>
+#include <string.h>
 #include "lab.h"
 
+/**
+ * @brief CPU hint for busy-wait loops: lets a sibling hyperthread run and
+ *        avoids the memory-order pipeline flush when the loop exits.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+/**
+ * @brief USDT probes (provider "queue") for perf, bpftrace and SystemTap,
+ *        written out here so sys/sdt.h is not needed. Each probe is one
+ *        nop plus an ELF note in .note.stapsdt giving its address and how
+ *        to find each argument (a register, a constant or a memory
+ *        operand) when the nop is hit. A tracer attaching patches the nop
+ *        with a breakpoint; until then the probe costs that nop, because
+ *        the arguments are only described, never computed: PROBE_MEM
+ *        passes a field in place, so the tracer reads it at the probe.
+ *        Arguments are reported unsigned. Build with -DQUEUE_NO_PROBES to
+ *        leave them out.
+ */
+#if !defined(QUEUE_NO_PROBES) && (defined(__x86_64__) || defined(__aarch64__))
+#define QUEUE_PROBE_NOTE(name, args, ...)                                                      \
+    __asm__ __volatile__("990: nop\n"                                                          \
+                         ".pushsection .note.stapsdt,\"?\",\"note\"\n"                         \
+                         ".balign 4\n"                                                         \
+                         ".4byte 992f-991f, 994f-993f, 3\n"                                    \
+                         "991: .asciz \"stapsdt\"\n"                                          \
+                         "992: .balign 4\n"                                                    \
+                         "993: .8byte 990b\n"                                                  \
+                         ".8byte _.stapsdt.base\n"                                             \
+                         ".8byte 0\n"                                                          \
+                         ".asciz \"queue\"\n"                                                  \
+                         ".asciz \"" name "\"\n"                                               \
+                         ".asciz \"" args "\"\n"                                               \
+                         "994: .balign 4\n"                                                    \
+                         ".popsection\n"                                                       \
+                         ".ifndef _.stapsdt.base\n"                                            \
+                         ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+                         ".weak _.stapsdt.base\n"                                              \
+                         ".hidden _.stapsdt.base\n"                                            \
+                         "_.stapsdt.base: .space 1\n"                                          \
+                         ".size _.stapsdt.base, 1\n"                                           \
+                         ".popsection\n"                                                       \
+                         ".endif\n"                                                            \
+                         :: __VA_ARGS__)
+#else
+#define QUEUE_PROBE_NOTE(name, args, ...) ((void)0)
+#endif
+
+/**
+ * @brief Operands of a probe argument: its size (printed by %n as a
+ *        positive, i.e. unsigned, size) and the value itself, either as
+ *        an expression or, for PROBE_MEM, the lvalue in memory.
+ */
+#define PROBE_VAL(x) "n"(-(int)sizeof(x)), "nor"(x)
+#define PROBE_MEM(x) "n"(-(int)sizeof(x)), "m"(x)
+#define QUEUE_PROBE1(name, a) QUEUE_PROBE_NOTE(name, "%n0@%1", a)
+#define QUEUE_PROBE2(name, a, b) QUEUE_PROBE_NOTE(name, "%n0@%1 %n2@%3", a, b)
+#define QUEUE_PROBE4(name, a, b, c, d) \
+    QUEUE_PROBE_NOTE(name, "%n0@%1 %n2@%3 %n4@%5 %n6@%7", a, b, c, d)
+
+/**
+ * @brief queue:enqueue and queue:dequeue, fired once n items went in or
+ *        came out: arg0 is the queue, arg1 is n, and arg2 - arg3 is the
+ *        number of items in the queue when the tracer reads them. The
+ *        lock-free rings pass ring_tail and ring_head, read racily; the
+ *        locked queues pass their count and 0, read under the lock.
+ */
+#define probe_ring(name, q, n) \
+    QUEUE_PROBE4(name, PROBE_VAL(q), PROBE_VAL(n), PROBE_MEM((q)->ring_tail), PROBE_MEM((q)->ring_head))
+#define probe_count(name, q, n, count) \
+    QUEUE_PROBE4(name, PROBE_VAL(q), PROBE_VAL(n), PROBE_MEM(count), PROBE_VAL(0))
+
+/**
+ * @brief queue:producer_blocked and queue:consumer_blocked, fired by a
+ *        thread about to sleep on the queue (arg0), and
+ *        queue:producer_woken and queue:consumer_woken once it runs again
+ *        (arg1 is 1 if it gave up at its deadline). Spinning and yielding
+ *        first, per the wait strategy, does not count as blocked.
+ */
+static inline void probe_blocked(const void *q, bool producer) {
+    (void)q; // Unused when the probes are left out
+    if (producer) {
+        QUEUE_PROBE1("producer_blocked", PROBE_VAL(q));
+    } else {
+        QUEUE_PROBE1("consumer_blocked", PROBE_VAL(q));
+    }
+}
+
+static inline void probe_woken(const void *q, bool producer, bool timed_out) {
+    (void)q; // Unused when the probes are left out
+    (void)timed_out;
+    if (producer) {
+        QUEUE_PROBE2("producer_woken", PROBE_VAL(q), PROBE_VAL(timed_out));
+    } else {
+        QUEUE_PROBE2("consumer_woken", PROBE_VAL(q), PROBE_VAL(timed_out));
+    }
+}
+
+/**
+ * @brief Smallest spin budget the adaptive wait strategy shrinks to, so a
+ *        queue that always parks can still notice when spinning pays off.
+ */
+#define SPIN_FLOOR 16
+
+/**
+ * @brief Deadline sentinel meaning "do not wait at all". Internal wait
+ *        paths take a deadline pointer: NULL waits forever, NO_WAIT never
+ *        waits, anything else is an absolute CLOCK_MONOTONIC time.
+ */
+static const struct timespec no_wait_deadline = {0, 0};
+#define NO_WAIT (&no_wait_deadline)
+
+/**
+ * @brief The functions serving one kind of queue. queue_init_attr picks a
+ *        table once from the queue's options, so the per-item, span,
+ *        emptiness and stats paths are compiled for exactly those options
+ *        and never test them again.
+ *        Entries a queue does not support reject the call the way the
+ *        public API documents (QUEUE_SHUTDOWN, or 0 items).
+ */
+struct queue_ops {
+    // out is a void ** for pointer queues and an element buffer for sized ones.
+    queue_status_t (*enqueue)(queue_t q, void *data, const struct timespec *deadline);
+    queue_status_t (*dequeue)(queue_t q, void *out, const struct timespec *deadline);
+    queue_status_t (*enqueue_copy)(queue_t q, void *elem, const struct timespec *deadline);
+    queue_status_t (*dequeue_copy)(queue_t q, void *out, const struct timespec *deadline);
+    int (*enqueue_batch)(queue_t q, void **items, int n);
+    int (*dequeue_batch)(queue_t q, void **out, int max, int min);
+    queue_status_t (*reserve)(queue_t q, int n, queue_span_t *span);
+    queue_status_t (*commit)(queue_t q, int n);
+    queue_status_t (*peek_span)(queue_t q, int max, queue_span_t *span);
+    void (*release)(queue_t q, int n);
+    bool (*is_empty)(queue_t q);
+    void (*stats)(queue_t q, queue_stats_t *stats);
+    bool compact;                // queue_t points at a struct compact_queue
+};
+
+// Span, emptiness and stats entries, defined with the public calls they
+// serve further down.
+static queue_status_t mutex_reserve(queue_t q, int n, queue_span_t *span);
+static queue_status_t mutex_commit(queue_t q, int n);
+static queue_status_t mutex_peek_span(queue_t q, int max, queue_span_t *span);
+static void mutex_release(queue_t q, int n);
+static queue_status_t spsc_reserve(queue_t q, int n, queue_span_t *span);
+static queue_status_t spsc_commit(queue_t q, int n);
+static queue_status_t spsc_peek_span(queue_t q, int max, queue_span_t *span);
+static void spsc_release(queue_t q, int n);
+static bool mutex_is_empty(queue_t q);
+static bool ring_is_empty(queue_t q);
+static bool compact_is_empty(queue_t q);
+static void mutex_stats(queue_t q, queue_stats_t *stats);
+static void sized_stats(queue_t q, queue_stats_t *stats);
+static void spsc_stats(queue_t q, queue_stats_t *stats);
+static void mpmc_stats(queue_t q, queue_stats_t *stats);
+static void lossy_stats(queue_t q, queue_stats_t *stats);
+static void unbounded_stats(queue_t q, queue_stats_t *stats);
+static void compact_stats(queue_t q, queue_stats_t *stats);
+
+/**
+ * @brief One slot of the MPMC ring.
+ *        seq == 2 * pos means the slot is free for the producer claiming pos;
+ *        seq == 2 * pos + 1 means it holds the item for the consumer claiming pos.
+ *        A consumer hands the slot to the next lap by storing 2 * (pos + capacity).
+ *        Doubling keeps the two states apart even when capacity is 1.
+ */
+struct ring_slot {
+    atomic_size_t seq;           // Sequence number gating ownership of the slot
+    void *data;                  // The item stored in the slot
+};
+
+/**
+ * @brief One cell of the lossy ring (QUEUE_OVERFLOW_OVERWRITE). Producers
+ *        and consumers swap the item pointer in and out, so whoever swaps
+ *        an item out owns it, and stored counts the producers that have
+ *        finished with the cell: once it covers a consumer's lap, an
+ *        empty cell means the item for that position is already gone.
+ */
+struct lossy_cell {
+    _Atomic(void *) item;        // The item in the cell, or NULL
+    atomic_size_t stored;        // Producers that have swapped an item in
+};
+
+static_assert(sizeof(struct lossy_cell) == sizeof(struct ring_slot),
+              "the lossy ring lives in the MPMC slot array");
+
+/**
+ * @brief Items per segment of the unbounded backend, so that a segment,
+ *        link included, fills a 4 KiB page.
+ */
+#define SEGMENT_ITEMS 511
+
+/**
+ * @brief Drained segments an unbounded queue keeps by default (see
+ *        queue_attr_setsegmentcache).
+ */
+#define SEGMENT_CACHE_DEFAULT 4
+
+/**
+ * @brief One segment of the unbounded backend. The queue is a list of
+ *        them from the oldest item's segment to the newest item's;
+ *        drained ones wait on a free list for reuse.
+ */
+struct segment {
+    struct segment *next;        // The next newer segment, or NULL
+    void *items[SEGMENT_ITEMS];  // The items, filled from index 0 up
+};
+
+/**
+ * @brief Bookkeeping for the threads parked on one condition variable of
+ *        the mutex backend, so wakers can signal exactly as many threads as
+ *        they have work for and skip the call when nobody is asleep.
+ *        Both counts are protected by the queue lock, as are writes to the
+ *        futex word.
+ */
+struct waiters {
+    int sleeping;                // Threads currently parked on the condition variable
+    int signaled;                // Of those, how many a wake-up is already on its way to
+    atomic_uint futex;           // Futex mode: wake sequence the parked threads sleep on
+};
+
+/**
+ * @brief Size of the cache lines the queue lays its fields out on.
+ */
+#define CACHE_LINE 64
+
+/**
+ * @brief Starts a new cache line inside struct queue. Building with
+ *        -DQUEUE_PACKED_LAYOUT drops the padding so benchmarks can compare
+ *        against fields that share lines.
+ */
+#ifdef QUEUE_PACKED_LAYOUT
+#define CACHE_ALIGNED
+#else
+#define CACHE_ALIGNED alignas(CACHE_LINE)
+#endif
+
+/**
+ * @brief The optional stats block of a queue (queue_attr_setstats).
+ *        Counters are relaxed atomics split by the side that writes them,
+ *        so queue_stats_snapshot can read them without any lock and
+ *        producers do not bounce the consumers' line. Every update is a
+ *        single atomic add or store, or a CAS that only retries when the
+ *        peak rose meanwhile, so the block never makes anyone wait; that
+ *        lets it live in the shared registry segment for named queues.
+ *        The per-item paths test q->counters at run time instead of
+ *        doubling every ops table; the pointer shares the read-mostly line
+ *        they load anyway.
+ */
+struct queue_counters {
+    // Producer side.
+    CACHE_ALIGNED atomic_size_t enqueued; // Items that entered the queue
+    atomic_size_t full_waits;    // Enqueues that found the queue full and waited
+    atomic_ullong enqueue_wait_ns; // Time spent in those waits
+    atomic_int peak_count;       // High-water mark of the occupancy
+    atomic_int blocked_producers; // Producers in a wait right now
+    // Consumer side.
+    CACHE_ALIGNED atomic_size_t dequeued; // Items that left the queue, evictions included
+    atomic_size_t empty_waits;   // Dequeues that found the queue empty and waited
+    atomic_ullong dequeue_wait_ns; // Time spent in those waits
+    atomic_int blocked_consumers; // Consumers in a wait right now
+    atomic_size_t latency[QUEUE_LATENCY_BUCKETS]; // Time-in-queue histogram
+};
+
+/**
+ * @brief Call sites of the mutex backend's lock, as told apart by the
+ *        lock profiler. Batches and spans count with the side they serve.
+ */
+enum lock_site { LOCK_ENQUEUE, LOCK_DEQUEUE, LOCK_IS_EMPTY, LOCK_IS_SHUTDOWN, LOCK_SHUTDOWN, LOCK_SITES };
+static_assert((int)LOCK_SITES == (int)QUEUE_LOCK_SITES, "lock sites must match queue_lock_site_t");
+
+#ifdef QUEUE_LOCK_PROFILE
+/**
+ * @brief What the lock profiler measured at one call site. Everything but
+ *        trylock_failures is written with q->lock held.
+ */
+struct lock_site_stats {
+    uint64_t acquires;           // Times the site took the lock
+    uint64_t contended;          // Of those, how many found it held
+    atomic_ullong trylock_failures; // Non-blocking calls that gave up on a held lock
+    uint64_t acquire_ns;         // Time from asking for the lock to getting it
+    uint64_t acquire_max_ns;
+    uint64_t hold_ns;            // Time from getting the lock to releasing or waiting
+    uint64_t hold_max_ns;
+    uint64_t wakeups;            // Waits ended by a signal rather than a timeout
+    uint64_t wake_ns;            // Time from the signal to running with the lock again
+    uint64_t wake_max_ns;
+};
+
+/**
+ * @brief Lock profiler state of a queue (-DQUEUE_LOCK_PROFILE), kept
+ *        under q->lock: who holds the lock since when, when each condition
+ *        variable was last signaled, and the per-site totals.
+ */
+struct lock_profile {
+    enum lock_site site;         // Site of the current holder
+    uint64_t acquired_at;        // When the current holder got the lock
+    uint64_t signaled_at[2];     // Last wake-up sent on not_full [0] and not_empty [1]
+    struct lock_site_stats sites[LOCK_SITES];
+};
+#endif
+
 /**
  * @brief Internal structure for the queue.
  *        Holds the buffer, capacity info, and synchronization primitives.
+ *        Fields are grouped by who writes them, one group per cache line,
+ *        so producers and consumers on different cores do not invalidate
+ *        each other's lines on every operation.
  */
 typedef struct queue {
+    // Read-mostly: set at init (shutdown once), read by every operation.
+    CACHE_ALIGNED const struct queue_ops *ops; // Functions chosen for this queue's options
     void **buffer;               // Array of void pointers (the circular buffer)
+    struct ring_slot *slots;     // MPMC: sequenced slots used instead of buffer
+    struct lossy_cell *cells;    // Overwrite mode: cells used instead of slots
+    size_t *sizes;               // Byte-bounded mode: bytes of the item in each slot
+    size_t max_bytes;            // Byte-bounded mode: budget for the queued items
+    unsigned char *elems;        // Sized mode: inline elements used instead of buffer
+    size_t elem_size;            // Sized mode: bytes per element, 0 for pointer queues
+    void *mapping;               // Mirrored/lazy mode: own mmap serving as the ring instead of storage
+    size_t mapping_bytes;        // Mirrored/lazy mode: length of mapping
+    bool mirrored;               // Mirrored mode: the ring is mapped twice, back to back
+    bool lazy;                   // Lazy mode: pages commit on first touch and are returned when drained
+    bool in_place;               // Lives in caller-provided memory that queue_destroy must not free
     int capacity;                // Maximum number of items in the queue
-    int count;                   // Current number of items in the queue
-    int head;                    // Index of the next item to dequeue
-    int tail;                    // Index of the next slot to enqueue
-    bool shutdown;               // Flag to indicate if shutdown has been called
-    pthread_mutex_t lock;        // Mutex to protect shared data
+    bool pow2;                   // Capacity is a power of two: index with mask
+    size_t mask;                 // capacity - 1, used when pow2 is set
+    queue_backend_t backend;     // Which implementation serves enqueue/dequeue
+    queue_parking_t parking;     // Mutex backend: how blocked threads sleep
+    int spin_limit;              // Wait strategy: most pause-spins before yielding
+    int yield_limit;             // Wait strategy: sched_yield rounds before parking
+    bool spin_adaptive;          // Wait strategy: tune spin_budget from wait outcomes
+    queue_overflow_t overflow;   // What enqueue does when the queue is full
+    queue_evict_t evict;         // Receives evicted items, or NULL
+    void *evict_arg;             // Second argument to evict
+    struct queue_counters *counters; // Stats mode: operation counters, NULL otherwise
+    uint64_t *stamps;            // Stats mode: CLOCK_MONOTONIC ns at which each slot was filled
+    struct registry_slot *published; // Named queues: the registry slot holding counters
+    atomic_bool shutdown;        // Flag to indicate if shutdown has been called
+
+    // Producer-owned: written by enqueue, read by consumers only when
+    // their cached view runs out.
+    CACHE_ALIGNED atomic_size_t ring_tail; // SPSC/MPMC: position of the next slot to enqueue
+    size_t cached_head;          // SPSC: producer's last observed ring_head
+    int tail;                    // Mutex backend: index of the next slot to enqueue; unbounded: in seg_tail
+    struct segment *seg_tail;    // Unbounded: segment receiving new items, NULL before the first
+    int reserved;                // Slots held by the pending queue_reserve, 0 if none
+    atomic_size_t rejected;      // New items refused by QUEUE_OVERFLOW_REJECT
+    atomic_size_t evicted;       // Old items dropped by QUEUE_OVERFLOW_EVICT/OVERWRITE
+
+    // Consumer-owned: the mirror image of the producer line.
+    CACHE_ALIGNED atomic_size_t ring_head; // SPSC/MPMC: position of the next item to dequeue
+    size_t cached_tail;          // SPSC: consumer's last observed ring_tail
+    int head;                    // Mutex backend: index of the next item to dequeue; unbounded: in seg_head
+    struct segment *seg_head;    // Unbounded: segment holding the oldest item, NULL when none is linked
+    int peeked;                  // Items lent out by the pending queue_peek_span, 0 if none
+    size_t since_trim;           // Lazy mode: slots dequeued since pages were last returned
+
+    // Shared by both sides: the lock, the occupancy it guards and the
+    // bookkeeping for threads that block.
+    CACHE_ALIGNED pthread_mutex_t lock; // Mutex to protect shared data
+    atomic_int count;            // Current number of items in the queue (written under lock, pre-checked without it)
+    atomic_size_t bytes;         // Byte-bounded mode: bytes of the queued items (written under lock)
+    atomic_size_t peak_bytes;    // Byte-bounded mode: high-water mark of bytes
+    struct waiters producers;    // Producers parked on not_full
+    struct waiters consumers;    // Consumers parked on not_empty
+    atomic_int waiting_producers; // Lock-free backends: unsignaled producers parked on not_full
+    atomic_int waiting_consumers; // Lock-free backends: unsignaled consumers parked on not_empty
+    atomic_int spin_budget;      // Wait strategy: pause-spins the next waiter will try
+    struct segment *seg_free;    // Unbounded: drained segments kept for reuse
+    int seg_cached;              // Unbounded: segments on seg_free
+    int seg_cache;               // Unbounded: most segments seg_free may hold
+    atomic_size_t segments;      // Unbounded: segments allocated, cached ones included (written under lock)
     pthread_cond_t not_full;     // Condition variable for producer wait
     pthread_cond_t not_empty;    // Condition variable for consumer wait
+#ifdef QUEUE_LOCK_PROFILE
+    struct lock_profile profile; // Lock profiler: per call site timings of lock
+#endif
+
+    // The buffer or slot array, in the same allocation as the header.
+    CACHE_ALIGNED unsigned char storage[];
 } *queue_t;
 
 /**
- * @brief Initializes a new queue with the given capacity.
+ * @brief A compact queue: the monitor of the mutex backend shrunk to a few
+ *        words. The lock is a single word and blocked threads park in the
+ *        global parking lot, keyed by the address they wait on, instead of
+ *        in per-queue mutexes and condition variables. queue_t points at
+ *        it; ops comes first, where struct queue keeps it too, so calls can
+ *        dispatch before touching anything else, and ops->compact tells
+ *        the rest that no other field of struct queue exists.
+ */
+struct compact_queue {
+    const struct queue_ops *ops; // Must stay first (see static_assert below)
+    atomic_uint lock;            // WORD_LOCKED and WORD_PARKED bits
+    int capacity;                // Maximum number of items in the queue
+    int head;                    // Index of the next item to dequeue
+    int count;                   // Current number of items, under lock
+    int producers;               // Producers parked on &producers, under lock
+    int consumers;               // Consumers parked on &consumers, under lock
+    atomic_bool shutdown;        // Flag to indicate if shutdown has been called
+    void *slots[];               // The circular buffer
+};
+
+static_assert(offsetof(struct queue, ops) == 0 && offsetof(struct compact_queue, ops) == 0,
+              "queue_t dispatches through the first field of either layout");
+
+/**
+ * @brief Maps a ring position to its slot, with a mask instead of a
+ *        division when the capacity is a power of two.
+ *
+ * @param q The queue.
+ * @param pos Position (or index) to wrap.
+ * @return Index into the buffer or slot array.
+ */
+static inline size_t ring_index(queue_t q, size_t pos) {
+    return q->pow2 ? pos & q->mask : pos % (size_t)q->capacity;
+}
+
+/**
+ * @brief Forces a function into its callers, so the variants in the ops
+ *        tables each get a copy compiled for their constant options.
+ */
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+/**
+ * @brief ring_index for callers that know at compile time whether the
+ *        capacity is a power of two.
+ */
+static ALWAYS_INLINE size_t ring_slot(queue_t q, size_t pos, const bool pow2) {
+    return pow2 ? pos & q->mask : pos % (size_t)q->capacity;
+}
+
+/**
+ * @brief Advances a mutex backend index by n <= capacity slots, wrapping
+ *        with a compare instead of a division.
+ *
+ * @param q The queue.
+ * @param index Current index, below capacity.
+ * @param n Number of slots to advance.
+ * @return The new index.
+ */
+static inline int ring_advance(queue_t q, int index, int n) {
+    unsigned next = (unsigned)index + (unsigned)n;
+    return next >= (unsigned)q->capacity ? (int)(next - (unsigned)q->capacity) : (int)next;
+}
+
+/**
+ * @brief Size of a transparent huge page; placed rings asking for huge
+ *        pages are aligned and padded to it so the kernel can use them.
+ */
+#define HUGE_PAGE (2UL * 1024 * 1024)
+
+/**
+ * @brief Applies a NUMA policy to [addr, addr + len) with a raw mbind
+ *        call, so libnuma is not needed. Interleaving spreads the pages
+ *        over every node this thread may allocate from.
+ *
+ * @param addr Page-aligned start of the range.
+ * @param len Length of the range.
+ * @param placement The policy and, for QUEUE_NUMA_BIND, the node.
+ * @return 0 on success, -1 with errno set on failure.
+ */
+static int numa_place(void *addr, size_t len, const queue_placement_t *placement) {
+    unsigned long mask[16] = {0};
+    unsigned long maxnode = sizeof(mask) * CHAR_BIT;
+    int mode = MPOL_BIND;
+    if (placement->policy == QUEUE_NUMA_INTERLEAVE) {
+        mode = MPOL_INTERLEAVE;
+        if (syscall(SYS_get_mempolicy, NULL, mask, maxnode, NULL, MPOL_F_MEMS_ALLOWED) != 0) {
+            return -1;
+        }
+    } else {
+        if (placement->node < 0 || (unsigned long)placement->node >= maxnode) {
+            errno = EINVAL;
+            return -1;
+        }
+        mask[placement->node / (sizeof(mask[0]) * CHAR_BIT)] |=
+            1UL << (placement->node % (sizeof(mask[0]) * CHAR_BIT));
+    }
+    // The kernel reads maxnode - 1 bits of the mask.
+    return (int)syscall(SYS_mbind, addr, len, mode, mask, maxnode + 1, 0);
+}
+
+/**
+ * @brief Maps a ring of its own for the lazy and placed modes. Pages are
+ *        only committed on first touch, so a NUMA policy set here decides
+ *        where every slot lands.
+ *
+ * @param bytes Size of the ring; updated to the length actually mapped.
+ * @param lazy Map with MAP_NORESERVE so huge rings do not count against
+ *             overcommit.
+ * @param placement Huge page and NUMA requests, or NULL.
+ * @return The mapping, or NULL if it or the requested NUMA policy failed.
+ *         Huge pages are a hint and never cause a failure.
+ */
+static void *ring_map(size_t *bytes, bool lazy, const queue_placement_t *placement) {
+    bool huge = placement != NULL && placement->huge_pages;
+    size_t len = huge ? (*bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE : *bytes;
+    // Over-map by one huge page so the ring can start on a huge page boundary.
+    size_t span = huge ? len + HUGE_PAGE : len;
+    unsigned char *map = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | (lazy ? MAP_NORESERVE : 0), -1, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    unsigned char *ring = map;
+    if (huge) {
+        ring = (unsigned char *)(((uintptr_t)map + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+        if (ring > map) {
+            munmap(map, (size_t)(ring - map));
+        }
+        if (map + span > ring + len) {
+            munmap(ring + len, (size_t)(map + span - (ring + len)));
+        }
+        madvise(ring, len, MADV_HUGEPAGE);
+    }
+    if (placement != NULL && placement->policy != QUEUE_NUMA_DEFAULT &&
+        numa_place(ring, len, placement) != 0) {
+        munmap(ring, len);
+        return NULL;
+    }
+    *bytes = len;
+    return ring;
+}
+
+/**
+ * @brief Queues one process can publish at a time.
+ */
+#define REGISTRY_SLOTS 64
+
+/**
+ * @brief Identifies a registry segment of this layout ("QTOP").
+ */
+#define REGISTRY_MAGIC 0x51544f50u
+
+/**
+ * @brief States of a registry slot. Only a LIVE slot is shown to readers.
+ */
+enum { SLOT_FREE, SLOT_BUSY, SLOT_LIVE };
+
+/**
+ * @brief One named queue in the registry segment. The owning process
+ *        claims and releases the slot with the state word and bumps
+ *        generation on both, so a reader that sees the same generation
+ *        before and after copying a LIVE slot knows it copied one queue.
+ */
+struct registry_slot {
+    struct queue_counters counters; // The queue's stats block itself
+    atomic_uint state;           // SLOT_FREE, SLOT_BUSY or SLOT_LIVE
+    atomic_uint generation;      // Bumped whenever the slot changes hands
+    int capacity;                // Maximum number of items in the queue
+    int backend;                 // queue_backend_t of the queue
+    char name[QUEUE_NAME_MAX];   // NUL-terminated name
+};
+
+/**
+ * @brief The shared memory segment /queuetop.<pid> of one process. magic
+ *        is stored last, once the rest is in place.
+ */
+struct registry {
+    atomic_uint magic;           // REGISTRY_MAGIC once initialized
+    unsigned size;               // sizeof(struct registry) of the writer
+    int pid;                     // The owning process
+    CACHE_ALIGNED struct registry_slot slots[REGISTRY_SLOTS];
+};
+
+/**
+ * @brief A registry mapped by queue_registry_open.
+ */
+struct queue_registry {
+    const struct registry *map;  // The read-only mapping
+};
+
+static struct registry *registry;  // This process's segment, once created
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Writes the shared memory name of pid's registry into name.
+ */
+static void registry_name(char *name, size_t len, int pid) {
+    snprintf(name, len, "/queuetop.%d", pid);
+}
+
+/**
+ * @brief Removes this process's segment at exit; mappings of readers stay
+ *        valid until they unmap them.
+ */
+static void registry_unlink(void) {
+    char name[32];
+    registry_name(name, sizeof(name), getpid());
+    shm_unlink(name);
+}
+
+/**
+ * @brief Creates this process's segment, once. A segment left behind by
+ *        an earlier process with the same pid is replaced. On failure
+ *        registry stays NULL and named queues keep private stats.
+ */
+static void registry_create(void) {
+    char name[32];
+    registry_name(name, sizeof(name), getpid());
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        return;
+    }
+    // ftruncate zero-fills the segment, so every slot starts out free.
+    struct registry *map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(struct registry)) == 0) {
+        map = mmap(NULL, sizeof(struct registry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name);
+        return;
+    }
+    map->size = sizeof(struct registry);
+    map->pid = getpid();
+    atomic_store_explicit(&map->magic, REGISTRY_MAGIC, memory_order_release);
+    registry = map;
+    atexit(registry_unlink);
+}
+
+/**
+ * @brief Claims a free registry slot for a named queue and zeroes its
+ *        counters.
+ *
+ * @return The slot, or NULL if there is no registry or no free slot.
+ */
+static struct registry_slot *registry_claim(const char *name, int capacity,
+                                            queue_backend_t backend) {
+    pthread_once(&registry_once, registry_create);
+    if (registry == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < REGISTRY_SLOTS; i++) {
+        struct registry_slot *slot = &registry->slots[i];
+        unsigned expected = SLOT_FREE;
+        if (atomic_compare_exchange_strong(&slot->state, &expected, SLOT_BUSY)) {
+            atomic_fetch_add(&slot->generation, 1);
+            memset(&slot->counters, 0, sizeof(slot->counters));
+            slot->capacity = capacity;
+            slot->backend = (int)backend;
+            snprintf(slot->name, sizeof(slot->name), "%s", name);
+            atomic_store_explicit(&slot->state, SLOT_LIVE, memory_order_release);
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Hands a registry slot back once its queue is destroyed.
+ */
+static void registry_release(struct registry_slot *slot) {
+    atomic_store(&slot->state, SLOT_BUSY);
+    atomic_fetch_add(&slot->generation, 1);
+    atomic_store_explicit(&slot->state, SLOT_FREE, memory_order_release);
+}
+
+/**
+ * @brief Sets up the stats block of a queue being created: the slot
+ *        stamps and the counters, in the registry when the queue is named
+ *        and the registry has room, or in an allocation of their own.
+ *
+ * @return False if memory ran out.
+ */
+static bool stats_create(queue_t q, const queue_attr_t *attr, int capacity) {
+    size_t stamps = (sizeof(uint64_t) * (size_t)capacity + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    q->stamps = aligned_alloc(CACHE_LINE, stamps);
+    q->published = attr->name[0] != '\0' ? registry_claim(attr->name, capacity, attr->backend) : NULL;
+    if (q->published != NULL) {
+        q->counters = &q->published->counters;
+    } else {
+        q->counters = aligned_alloc(alignof(struct queue_counters), sizeof(struct queue_counters));
+        if (q->counters != NULL) {
+            memset(q->counters, 0, sizeof(*q->counters));
+        }
+    }
+    return q->stamps != NULL && q->counters != NULL;
+}
+
+/**
+ * @brief Frees the stats block of a queue, if it has one.
+ */
+static void stats_destroy(queue_t q) {
+    free(q->stamps);
+    if (q->published != NULL) {
+        registry_release(q->published);
+    } else {
+        free(q->counters);
+    }
+}
+
+static const struct queue_ops *select_ops(queue_t q);
+static queue_t compact_create(int capacity);
+static void compact_shutdown(struct compact_queue *cq);
+static void unbounded_free(queue_t q);
+
+/**
+ * @brief Size of the single allocation holding a queue: the header plus,
+ *        unless the ring gets a mapping of its own, the ring itself,
+ *        rounded up to whole cache lines.
+ *
+ * @param backend The implementation that will serve the queue.
+ * @param elem_size Bytes per inline element, or 0 to queue pointers.
+ * @param capacity The maximum number of items.
+ * @param mapped Whether the ring lives in a mapping of its own.
+ * @param bounded Whether a byte budget needs the size of every slot kept
+ *                next to the ring.
+ * @return The size in bytes, or 0 if it does not fit in a size_t.
+ */
+static size_t queue_bytes(queue_backend_t backend, size_t elem_size, int capacity, bool mapped,
+                          bool bounded) {
+    size_t elem = backend == QUEUE_BACKEND_MPMC ? sizeof(struct ring_slot) : sizeof(void *);
+    if (elem_size != 0) {
+        elem = elem_size;
+    }
+    if ((size_t)capacity > (SIZE_MAX - sizeof(struct queue) - CACHE_LINE) / (elem + sizeof(size_t))) {
+        return 0;
+    }
+    size_t size = sizeof(struct queue) + (mapped ? 0 : elem * (size_t)capacity) +
+                  (bounded ? sizeof(size_t) * (size_t)capacity : 0);
+    return (size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+/**
+ * @brief Allocates and initializes a queue as described by attr, which
+ *        queue_init_attr has already checked.
+ *
+ * @param attr The creation attributes.
+ * @param capacity The maximum number of items, already rounded if requested.
+ * @param mem Cache-line aligned memory of at least queue_bytes() to build
+ *            the queue in, or NULL to allocate it.
+ * @return A pointer to the initialized queue, or NULL on failure.
+ */
+static queue_t queue_create(const queue_attr_t *attr, int capacity, void *mem) {
+    queue_backend_t backend = attr->backend;
+    size_t elem_size = attr->elem_size;
+    bool lazy = attr->lazy;
+    const queue_placement_t *placement = &attr->placement;
+    // The header and the buffer share one allocation on a cache-line
+    // boundary, so the field groups land on their own lines and the slots
+    // follow right behind; the MPMC ring keeps its items in sequenced slots
+    // and sized queues keep copies of the elements themselves.
+    size_t elem = backend == QUEUE_BACKEND_MPMC ? sizeof(struct ring_slot) : sizeof(void *);
+    if (elem_size != 0) {
+        elem = elem_size;
+    }
+    // Placement requests need the ring in a mapping of its own, too.
+    bool placed = placement->huge_pages || placement->policy != QUEUE_NUMA_DEFAULT;
+    bool mapped = lazy || placed;
+    bool bounded = attr->max_bytes != 0;
+    size_t size = queue_bytes(backend, elem_size, capacity, mapped, bounded);
+    if (size == 0) {
+        return NULL;
+    }
+    queue_t q = mem != NULL ? mem : aligned_alloc(alignof(struct queue), size);
+    if (q == NULL) { // Check for allocation failure
+        return NULL;  
+    }
+    // The stats block is opt-in and kept out of the queue's allocation.
+    q->counters = NULL;
+    q->stamps = NULL;
+    q->published = NULL;
+    q->in_place = mem != NULL;
+    if ((attr->stats || attr->name[0] != '\0') && !stats_create(q, attr, capacity)) {
+        stats_destroy(q);
+        if (!q->in_place) {
+            free(q);
+        }
+        return NULL;
+    }
+    q->elem_size = elem_size;
+    q->mapping = NULL;
+    q->mapping_bytes = 0;
+    q->mirrored = false;
+    q->lazy = lazy;
+    unsigned char *ring = q->storage;
+    if (mapped) {
+        q->mapping_bytes = elem * (size_t)capacity;
+        q->mapping = ring_map(&q->mapping_bytes, lazy, placed ? placement : NULL);
+        if (q->mapping == NULL) {
+            stats_destroy(q);
+            if (!q->in_place) {
+                free(q);
+            }
+            return NULL;
+        }
+        ring = q->mapping;
+    }
+    q->buffer = NULL;
+    q->slots = NULL;
+    q->cells = NULL;
+    q->elems = NULL;
+    if (elem_size != 0) {
+        q->elems = ring;
+    } else if (backend == QUEUE_BACKEND_MPMC && attr->overflow == QUEUE_OVERFLOW_OVERWRITE) {
+        q->cells = (struct lossy_cell *)ring;
+    } else if (backend == QUEUE_BACKEND_MPMC) {
+        q->slots = (struct ring_slot *)ring;
+    } else {
+        q->buffer = (void **)ring;
+    }
+    for (int i = 0; q->slots != NULL && i < capacity; i++) {
+        atomic_init(&q->slots[i].seq, 2 * (size_t)i);
+        q->slots[i].data = NULL;
+    }
+    for (int i = 0; q->cells != NULL && i < capacity; i++) {
+        atomic_init(&q->cells[i].item, NULL);
+        atomic_init(&q->cells[i].stored, 0);
+    }
+    // Slot sizes follow whatever of the ring lives in storage.
+    q->sizes = bounded ? (size_t *)(q->storage + (mapped ? 0 : elem * (size_t)capacity)) : NULL;
+    q->max_bytes = attr->max_bytes;
+    atomic_init(&q->bytes, 0);
+    atomic_init(&q->peak_bytes, 0);
+    // Set values
+    q->capacity = capacity;
+    q->pow2 = (capacity & (capacity - 1)) == 0;
+    q->mask = (size_t)capacity - 1;
+    atomic_init(&q->count, 0);
+    q->head = 0;
+    q->tail = 0;
+    q->reserved = 0;
+    q->peeked = 0;
+    q->since_trim = 0;
+    // The unbounded backend has no ring; the first enqueue finds the
+    // (missing) tail segment full and links one in.
+    q->seg_head = NULL;
+    q->seg_tail = NULL;
+    q->seg_free = NULL;
+    q->seg_cached = 0;
+    q->seg_cache = attr->segment_cache;
+    atomic_init(&q->segments, 0);
+    // Nothing indexes a ring on it either: unbounded_ops has no ring path
+    // and the span calls refuse the backend, so the mask is left inert.
+    if (backend == QUEUE_BACKEND_UNBOUNDED) {
+        q->capacity = INT_MAX;
+        q->pow2 = false;
+        q->mask = 0;
+        q->tail = SEGMENT_ITEMS;
+    }
+    q->shutdown = false;
+    q->producers.sleeping = q->producers.signaled = 0;
+    q->consumers.sleeping = q->consumers.signaled = 0;
+    atomic_init(&q->producers.futex, 0);
+    atomic_init(&q->consumers.futex, 0);
+    q->backend = backend;
+    q->parking = attr->parking;
+    q->spin_limit = attr->wait.spin > 0 ? attr->wait.spin : 0;
+    q->yield_limit = attr->wait.yield > 0 ? attr->wait.yield : 0;
+    q->spin_adaptive = attr->wait.adaptive;
+    q->overflow = attr->overflow;
+    q->evict = attr->evict;
+    q->evict_arg = attr->evict_arg;
+    atomic_init(&q->rejected, 0);
+    atomic_init(&q->evicted, 0);
+    atomic_init(&q->spin_budget, q->spin_limit);
+    atomic_init(&q->ring_head, 0);
+    atomic_init(&q->ring_tail, 0);
+    q->cached_head = 0;
+    q->cached_tail = 0;
+    atomic_init(&q->waiting_producers, 0);
+    atomic_init(&q->waiting_consumers, 0);
+    q->ops = select_ops(q);
+#ifdef QUEUE_LOCK_PROFILE
+    memset(&q->profile, 0, sizeof(q->profile));
+#endif
+    // Handle mutex for thread safety, create condition variables, then return. 
+    pthread_mutex_init(&q->lock, NULL);
+    // Timed waits take CLOCK_MONOTONIC deadlines so wall-clock jumps cannot stretch them.
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&q->not_full, &cattr); // producers wait if queue is full
+    pthread_cond_init(&q->not_empty, &cattr); // consumers wait if queue is empty
+    pthread_condattr_destroy(&cattr);
+    return q;
+}
+
+/**
+ * @brief Initializes queue attributes to the defaults of queue_init.
+ *
+ * @param attr The attributes.
+ * @return 0, or EINVAL if attr is NULL.
+ */
+int queue_attr_init(queue_attr_t *attr) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    memset(attr, 0, sizeof(*attr));
+    attr->backend = QUEUE_BACKEND_MUTEX;
+    attr->parking = QUEUE_PARK_CONDVAR;
+    attr->placement.policy = QUEUE_NUMA_DEFAULT;
+    attr->segment_cache = SEGMENT_CACHE_DEFAULT;
+    return 0;
+}
+
+/**
+ * @brief Destroys queue attributes. They own no resources, so this only
+ *        exists to mirror pthread_attr_destroy.
+ *
+ * @param attr The attributes.
+ * @return 0, or EINVAL if attr is NULL.
+ */
+int queue_attr_destroy(queue_attr_t *attr) {
+    return attr == NULL ? EINVAL : 0;
+}
+
+/**
+ * @brief Sets the maximum number of items.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setcapacity(queue_attr_t *attr, int capacity) {
+    if (attr == NULL || capacity <= 0) {
+        return EINVAL;
+    }
+    attr->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Selects the backend that will serve the queue.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setbackend(queue_attr_t *attr, queue_backend_t backend) {
+    if (attr == NULL || (backend != QUEUE_BACKEND_MUTEX && backend != QUEUE_BACKEND_SPSC &&
+                         backend != QUEUE_BACKEND_MPMC && backend != QUEUE_BACKEND_COMPACT &&
+                         backend != QUEUE_BACKEND_UNBOUNDED)) {
+        return EINVAL;
+    }
+    attr->backend = backend;
+    return 0;
+}
+
+/**
+ * @brief Selects how the mutex backend parks blocked threads.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setparking(queue_attr_t *attr, queue_parking_t parking) {
+    if (attr == NULL || (parking != QUEUE_PARK_CONDVAR && parking != QUEUE_PARK_FUTEX)) {
+        return EINVAL;
+    }
+    attr->parking = parking;
+    return 0;
+}
+
+/**
+ * @brief Sets the wait strategy; NULL parks right away.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setwaitstrategy(queue_attr_t *attr, const queue_wait_strategy_t *strategy) {
+    if (attr == NULL || (strategy != NULL && (strategy->spin < 0 || strategy->yield < 0))) {
+        return EINVAL;
+    }
+    if (strategy == NULL) {
+        memset(&attr->wait, 0, sizeof(attr->wait));
+    } else {
+        attr->wait = *strategy;
+    }
+    return 0;
+}
+
+/**
+ * @brief Sets the inline element size; 0 queues pointers.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setelemsize(queue_attr_t *attr, size_t elem_size) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    attr->elem_size = elem_size;
+    return 0;
+}
+
+/**
+ * @brief Rounds the capacity up to a power of two at creation.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setpow2(queue_attr_t *attr, bool pow2) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    attr->pow2 = pow2;
+    return 0;
+}
+
+/**
+ * @brief Reserves the ring as address space that commits on demand.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setlazy(queue_attr_t *attr, bool lazy) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    attr->lazy = lazy;
+    return 0;
+}
+
+/**
+ * @brief Mirrors the ring at creation when its size allows.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setmirrored(queue_attr_t *attr, bool mirrored) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    attr->mirrored = mirrored;
+    return 0;
+}
+
+/**
+ * @brief Sets huge page and NUMA placement; NULL restores the default.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setplacement(queue_attr_t *attr, const queue_placement_t *placement) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    if (placement == NULL) {
+        memset(&attr->placement, 0, sizeof(attr->placement));
+        attr->placement.policy = QUEUE_NUMA_DEFAULT;
+        return 0;
+    }
+    if ((placement->policy != QUEUE_NUMA_DEFAULT && placement->policy != QUEUE_NUMA_BIND &&
+         placement->policy != QUEUE_NUMA_INTERLEAVE) ||
+        (placement->policy == QUEUE_NUMA_BIND && placement->node < 0)) {
+        return EINVAL;
+    }
+    attr->placement = *placement;
+    return 0;
+}
+
+/**
+ * @brief Sets the overflow policy and the callback receiving evicted items.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setoverflow(queue_attr_t *attr, queue_overflow_t policy, queue_evict_t evict,
+                           void *arg) {
+    if (attr == NULL || (policy != QUEUE_OVERFLOW_BLOCK && policy != QUEUE_OVERFLOW_REJECT &&
+                         policy != QUEUE_OVERFLOW_EVICT && policy != QUEUE_OVERFLOW_OVERWRITE)) {
+        return EINVAL;
+    }
+    attr->overflow = policy;
+    attr->evict = evict;
+    attr->evict_arg = arg;
+    return 0;
+}
+
+/**
+ * @brief Sets the byte budget; 0 bounds the queue by count only.
+ *
+ * @return 0, or EINVAL for a NULL attr.
+ */
+int queue_attr_setmaxbytes(queue_attr_t *attr, size_t max_bytes) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    attr->max_bytes = max_bytes;
+    return 0;
+}
+
+/**
+ * @brief Keeps operation counters for queue_stats_snapshot.
+ *
+ * @return 0, or EINVAL for a NULL attr.
+ */
+int queue_attr_setstats(queue_attr_t *attr, bool stats) {
+    if (attr == NULL) {
+        return EINVAL;
+    }
+    attr->stats = stats;
+    return 0;
+}
+
+/**
+ * @brief Publishes the queue's stats in the registry under name.
+ *
+ * @return 0, or EINVAL for a NULL attr or a name that does not fit.
+ */
+int queue_attr_setname(queue_attr_t *attr, const char *name) {
+    if (attr == NULL || (name != NULL && strlen(name) >= sizeof(attr->name))) {
+        return EINVAL;
+    }
+    strcpy(attr->name, name != NULL ? name : "");
+    return 0;
+}
+
+/**
+ * @brief Sets how many drained segments an unbounded queue keeps.
+ *
+ * @return 0, or EINVAL for a NULL attr or an invalid value.
+ */
+int queue_attr_setsegmentcache(queue_attr_t *attr, int segments) {
+    if (attr == NULL || segments < 0) {
+        return EINVAL;
+    }
+    attr->segment_cache = segments;
+    return 0;
+}
+
+/**
+ * @brief Initializes a new queue from creation attributes, rejecting
+ *        combinations of options no backend implements.
+ *
+ * @param attr The attributes.
+ * @return A pointer to the newly created queue, or NULL on failure.
+ */
+queue_t queue_init_attr(const queue_attr_t *attr) {
+    bool unbounded = attr != NULL && attr->backend == QUEUE_BACKEND_UNBOUNDED;
+    if (attr == NULL || (attr->capacity <= 0 && !unbounded)) {
+        return NULL;
+    }
+    bool mutex = attr->backend == QUEUE_BACKEND_MUTEX;
+    bool placed = attr->placement.huge_pages || attr->placement.policy != QUEUE_NUMA_DEFAULT;
+    if (!mutex && (attr->elem_size != 0 || attr->lazy ||
+                   (attr->parking != QUEUE_PARK_CONDVAR && !unbounded))) {
+        return NULL;
+    }
+    // The unbounded queue parks like the mutex backend but has no ring to
+    // place, mirror, overflow, budget or stamp.
+    if (unbounded) {
+        if (attr->mirrored || placed || attr->overflow != QUEUE_OVERFLOW_BLOCK ||
+            attr->max_bytes != 0 || attr->stats || attr->name[0] != '\0') {
+            return NULL;
+        }
+        return queue_create(attr, 0, NULL);
+    }
+    if (attr->mirrored && (attr->lazy || placed || attr->backend == QUEUE_BACKEND_MPMC)) {
+        return NULL;
+    }
+    // The compact queue has no room for anything beyond its slots.
+    bool compact = attr->backend == QUEUE_BACKEND_COMPACT;
+    if (compact && (attr->mirrored || placed || attr->wait.spin > 0 || attr->wait.yield > 0 ||
+                    attr->overflow != QUEUE_OVERFLOW_BLOCK)) {
+        return NULL;
+    }
+    // Only the head's owner can evict, and only the MPMC ring turns lossy.
+    if ((attr->overflow == QUEUE_OVERFLOW_EVICT && attr->backend == QUEUE_BACKEND_SPSC) ||
+        (attr->overflow == QUEUE_OVERFLOW_OVERWRITE && attr->backend != QUEUE_BACKEND_MPMC)) {
+        return NULL;
+    }
+    // Byte accounting happens under the mutex backend's lock, per pointer.
+    if (attr->max_bytes != 0 && (!mutex || attr->elem_size != 0 || attr->mirrored)) {
+        return NULL;
+    }
+    // Lossy cells are swapped, not handed over, so nothing orders a stamp.
+    bool stats = attr->stats || attr->name[0] != '\0';
+    if (stats && (compact || attr->overflow == QUEUE_OVERFLOW_OVERWRITE)) {
+        return NULL;
+    }
+    int capacity = attr->pow2 ? queue_pow2_capacity(attr->capacity) : attr->capacity;
+    if (capacity <= 0) {
+        return NULL;
+    }
+    if (compact) {
+        return compact_create(capacity);
+    }
+    queue_t q = queue_create(attr, capacity, NULL);
+    if (q != NULL && attr->mirrored) {
+        queue_set_mirrored(q);
+    }
+    return q;
+}
+
+/**
+ * @brief Initializes a new queue with the given capacity.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return A pointer to the initialized queue.
+ */
+queue_t queue_init(int capacity) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Initializes a new single-producer/single-consumer queue.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return A pointer to the initialized queue.
+ */
+queue_t queue_init_spsc(int capacity) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_SPSC);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Initializes a new mutex-backed queue whose blocked threads park
+ *        on futex words instead of condition variables.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return A pointer to the initialized queue.
+ */
+queue_t queue_init_futex(int capacity) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setparking(&attr, QUEUE_PARK_FUTEX);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Initializes a new queue whose ring is reserved as address space
+ *        and committed page by page as it fills.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return A pointer to the newly created queue, or NULL on failure.
+ */
+queue_t queue_init_lazy(int capacity) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setlazy(&attr, true);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Initializes a new queue whose ring is placed as requested: backed
+ *        by transparent huge pages and/or bound to or interleaved across
+ *        NUMA nodes.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @param placement Where the ring should live; NULL behaves like queue_init.
+ * @return A pointer to the newly created queue, or NULL on failure
+ *         (including a NUMA policy the kernel rejects).
+ */
+queue_t queue_init_placed(int capacity, const queue_placement_t *placement) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    if (placement != NULL) {
+        // Let an out-of-range node reach mbind, which reports it.
+        attr.placement = *placement;
+    }
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Bytes of caller memory queue_init_in_place needs for a queue of
+ *        the given capacity, including the slack to align the header to a
+ *        cache line wherever the memory starts.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return The size in bytes, or 0 if capacity is not positive or too large.
+ */
+size_t queue_required_size(int capacity) {
+    if (capacity <= 0) {
+        return 0;
+    }
+    size_t size = queue_bytes(QUEUE_BACKEND_MUTEX, 0, capacity, false, false);
+    if (size == 0 || size > SIZE_MAX - (alignof(struct queue) - 1)) {
+        return 0;
+    }
+    return size + alignof(struct queue) - 1;
+}
+
+/**
+ * @brief Initializes a queue_init queue inside caller-provided memory, so
+ *        creating and destroying it never touches the heap.
+ *
+ * @param mem The memory; any alignment.
+ * @param size Bytes available at mem, at least queue_required_size(capacity).
+ * @param capacity The maximum number of items the queue can hold.
+ * @return The queue, which lives somewhere inside mem, or NULL if mem is
+ *         NULL or too small.
+ */
+queue_t queue_init_in_place(void *mem, size_t size, int capacity) {
+    size_t need = queue_required_size(capacity);
+    if (mem == NULL || need == 0 || size < need) {
+        return NULL;
+    }
+    uintptr_t at = ((uintptr_t)mem + alignof(struct queue) - 1) & ~(uintptr_t)(alignof(struct queue) - 1);
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    return queue_create(&attr, capacity, (void *)at);
+}
+
+/**
+ * @brief Maps bytes of memfd-backed memory twice, back to back, so that
+ *        byte i and byte i + bytes are the same memory.
+ *
+ * @param bytes Size of one copy, a multiple of the page size.
+ * @return Start of the 2 * bytes mapping, or NULL on failure.
+ */
+static void *mirror_map(size_t bytes) {
+    int fd = (int)syscall(SYS_memfd_create, "queue-ring", MFD_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    // Reserve the whole range first so the two halves are adjacent.
+    unsigned char *base = MAP_FAILED;
+    if (ftruncate(fd, (off_t)bytes) == 0) {
+        base = mmap(NULL, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (base != MAP_FAILED &&
+        (mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+         mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+        munmap(base, 2 * bytes);
+        base = MAP_FAILED;
+    }
+    close(fd); // The mappings keep the memory alive.
+    return base == MAP_FAILED ? NULL : base;
+}
+
+/**
+ * @brief Moves the ring of an unused queue into a mirrored mapping, so any
+ *        run of up to capacity slots is contiguous in virtual memory.
+ *        Must be called before the queue is shared or holds any item.
+ *
+ * @param q The queue.
+ * @return True if the ring is mirrored; false keeps the normal allocation
+ *         (MPMC queue, ring size not a multiple of the page size, or the
+ *         mapping failed).
+ */
+bool queue_set_mirrored(queue_t q) {
+    if (q == NULL || q->ops->compact || q->backend == QUEUE_BACKEND_MPMC ||
+        q->backend == QUEUE_BACKEND_UNBOUNDED || q->sizes != NULL) {
+        return false;
+    }
+    if (q->mirrored) {
+        return true;
+    }
+    if (q->mapping != NULL) {
+        return false; // Lazy rings keep their own mapping.
+    }
+    size_t elem = q->elem_size != 0 ? q->elem_size : sizeof(void *);
+    size_t bytes = elem * (size_t)q->capacity;
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0 || bytes % (size_t)page != 0) {
+        return false;
+    }
+    void *mirror = mirror_map(bytes);
+    if (mirror == NULL) {
+        return false;
+    }
+    q->mapping = mirror;
+    q->mapping_bytes = 2 * bytes;
+    q->mirrored = true;
+    if (q->elem_size != 0) {
+        q->elems = mirror;
+    } else {
+        q->buffer = mirror;
+    }
+    return true;
+}
+
+/**
+ * @brief Initializes a new queue that stores fixed-size elements inline.
+ *
+ * @param capacity The maximum number of elements the queue can hold.
+ * @param elem_size Size of each element in bytes.
+ * @return A pointer to the newly created queue, or NULL on failure.
+ */
+queue_t queue_init_sized(int capacity, size_t elem_size) {
+    if (elem_size == 0) {
+        return NULL;
+    }
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setelemsize(&attr, elem_size);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Rounds a capacity up to the next power of two. The lock-free
+ *        backends index their ring with a mask instead of a division when
+ *        given such a capacity; the mutex backend never divides.
+ *
+ * @param capacity The requested capacity.
+ * @return The rounded capacity, or 0 if capacity is not positive or the
+ *         result does not fit in an int.
+ */
+int queue_pow2_capacity(int capacity) {
+    if (capacity <= 0 || capacity > INT_MAX / 2 + 1) {
+        return 0;
+    }
+    int pow2 = 1;
+    while (pow2 < capacity) {
+        pow2 <<= 1;
+    }
+    return pow2;
+}
+
+/**
+ * @brief Sets how threads wait before they park on a full or empty queue.
+ *        Must be called before the queue is shared with other threads.
+ *
+ * @param q The queue.
+ * @param strategy Spin and yield budgets; NULL restores parking right away.
+ */
+void queue_set_wait_strategy(queue_t q, const queue_wait_strategy_t *strategy) {
+    if (q == NULL || q->ops->compact) {
+        return;
+    }
+    q->spin_limit = strategy != NULL && strategy->spin > 0 ? strategy->spin : 0;
+    q->yield_limit = strategy != NULL && strategy->yield > 0 ? strategy->yield : 0;
+    q->spin_adaptive = strategy != NULL && strategy->adaptive;
+    atomic_store(&q->spin_budget, q->spin_limit);
+}
+
+/**
+ * @brief Initializes a new lock-free multi-producer/multi-consumer queue.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return A pointer to the initialized queue.
+ */
+queue_t queue_init_mpmc(int capacity) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_MPMC);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Initializes a new compact queue, whose lock is one word and whose
+ *        blocked threads park in the global parking lot.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return A pointer to the initialized queue.
+ */
+queue_t queue_init_compact(int capacity) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_COMPACT);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Initializes a new unbounded queue, whose enqueue never waits for
+ *        space.
+ *
+ * @return A pointer to the initialized queue.
+ */
+queue_t queue_init_unbounded(void) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_UNBOUNDED);
+    return queue_init_attr(&attr);
+}
+
+/**
+ * @brief Waits on cond until signaled or until deadline passes.
+ *
+ * @param cond The condition variable, created with CLOCK_MONOTONIC.
+ * @param lock The mutex held by the caller.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return True if the deadline passed.
+ */
+static bool cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *lock,
+                            const struct timespec *deadline) {
+    if (deadline == NULL) {
+        pthread_cond_wait(cond, lock);
+        return false;
+    }
+    return pthread_cond_timedwait(cond, lock, deadline) == ETIMEDOUT;
+}
+
+/**
+ * @brief Sleeps on a futex word while it still holds expected.
+ *
+ * @param word The futex word.
+ * @param expected The value observed under the queue lock.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return True if the deadline passed.
+ */
+static bool futex_wait_until(atomic_uint *word, unsigned expected,
+                             const struct timespec *deadline) {
+    // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC timeout, unlike FUTEX_WAIT.
+    long rc = syscall(SYS_futex, word, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+                      expected, deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+    return rc == -1 && errno == ETIMEDOUT;
+}
+
+/**
+ * @brief Wakes up to n threads sleeping on a futex word.
+ *
+ * @param word The futex word.
+ * @param n Number of threads to wake.
+ */
+static void futex_wake(atomic_uint *word, int n) {
+    syscall(SYS_futex, word, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, n, NULL, NULL, 0);
+}
+
+/**
+ * @brief A thread parked in the global parking lot. Every thread owns one
+ *        in thread-local storage, since it parks on one address at a time.
+ */
+struct parked_thread {
+    const void *addr;            // Address the thread parked on
+    struct parked_thread *next;  // Next thread in the same bucket, FIFO
+    atomic_uint woken;           // Futex word the thread sleeps on; 1 once unparked
+};
+
+/**
+ * @brief One bucket of the parking lot: the threads parked on every
+ *        address that hashes to it.
+ */
+struct lot_bucket {
+    CACHE_ALIGNED pthread_mutex_t lock; // Guards the list
+    struct parked_thread *head;  // Oldest parked thread
+    struct parked_thread *tail;  // Newest parked thread
+};
+
+/**
+ * @brief Number of parking lot buckets, a power of two. Threads only sit
+ *        in the lot while blocked, so collisions cost a slightly longer
+ *        list walk, never a wrong wake-up.
+ */
+#define LOT_BUCKETS 256
+
+static struct lot_bucket parking_lot[LOT_BUCKETS];
+static pthread_once_t parking_lot_once = PTHREAD_ONCE_INIT;
+static _Thread_local struct parked_thread parked_self;
+
+static void lot_init(void) {
+    for (int i = 0; i < LOT_BUCKETS; i++) {
+        pthread_mutex_init(&parking_lot[i].lock, NULL);
+    }
+}
+
+/**
+ * @brief Maps an address to its bucket with a Fibonacci hash.
+ */
+static struct lot_bucket *lot_bucket(const void *addr) {
+    pthread_once(&parking_lot_once, lot_init);
+    uint64_t hash = (uint64_t)(uintptr_t)addr * 0x9E3779B97F4A7C15ULL;
+    return &parking_lot[hash >> (64 - 8)];
+}
+
+/**
+ * @brief Unlinks self from bucket b if it is still there. Called with the
+ *        bucket lock held.
+ *
+ * @return True if self was found and removed.
+ */
+static bool lot_remove(struct lot_bucket *b, struct parked_thread *self) {
+    struct parked_thread *prev = NULL;
+    for (struct parked_thread *t = b->head; t != NULL; prev = t, t = t->next) {
+        if (t == self) {
+            if (prev != NULL) {
+                prev->next = t->next;
+            } else {
+                b->head = t->next;
+            }
+            if (b->tail == t) {
+                b->tail = prev;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Parks the calling thread on addr, WebKit ParkingLot style.
+ *        validate() runs under the bucket lock, so an unparker of addr
+ *        either runs entirely before it (and validate sees its effect) or
+ *        finds this thread queued. Once queued, before_sleep() runs, which
+ *        is where a caller drops the lock it waits under, and the thread
+ *        sleeps on its own futex word until unparked or out of time.
+ *
+ * @param addr Any address; only used as a key.
+ * @param validate Returns false to not park after all, or NULL.
+ * @param before_sleep Called after queueing, before sleeping, or NULL.
+ * @param arg Passed to validate and before_sleep.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return True if the deadline passed before the thread was unparked.
+ */
+static bool lot_park(const void *addr, bool (*validate)(void *), void (*before_sleep)(void *),
+                     void *arg, const struct timespec *deadline) {
+    struct lot_bucket *b = lot_bucket(addr);
+    struct parked_thread *self = &parked_self;
+    pthread_mutex_lock(&b->lock);
+    if (validate != NULL && !validate(arg)) {
+        pthread_mutex_unlock(&b->lock);
+        return false;
+    }
+    self->addr = addr;
+    self->next = NULL;
+    atomic_store_explicit(&self->woken, 0, memory_order_relaxed);
+    if (b->tail != NULL) {
+        b->tail->next = self;
+    } else {
+        b->head = self;
+    }
+    b->tail = self;
+    pthread_mutex_unlock(&b->lock);
+    if (before_sleep != NULL) {
+        before_sleep(arg);
+    }
+    while (atomic_load_explicit(&self->woken, memory_order_acquire) == 0) {
+        if (futex_wait_until(&self->woken, 0, deadline)) {
+            // Out of time: leave the bucket, unless an unparker already
+            // took us out, in which case its wake-up has to be absorbed.
+            pthread_mutex_lock(&b->lock);
+            bool queued = lot_remove(b, self);
+            pthread_mutex_unlock(&b->lock);
+            if (queued) {
+                return true;
+            }
+            deadline = NULL;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Wakes the longest parked thread on addr, if any.
+ *
+ * @param addr The key the thread parked on.
+ * @param callback Called under the bucket lock with whether more threads
+ *                 remain parked on addr, or NULL.
+ * @param arg Passed to callback.
+ * @return True if a thread was woken.
+ */
+static bool lot_unpark_one(const void *addr, void (*callback)(void *, bool), void *arg) {
+    struct lot_bucket *b = lot_bucket(addr);
+    struct parked_thread *found = NULL;
+    bool more = false;
+    pthread_mutex_lock(&b->lock);
+    for (struct parked_thread *t = b->head; t != NULL; t = t->next) {
+        if (t->addr != addr) {
+            continue;
+        }
+        if (found != NULL) {
+            more = true;
+            break;
+        }
+        found = t;
+    }
+    if (found != NULL) {
+        lot_remove(b, found);
+    }
+    if (callback != NULL) {
+        callback(arg, more);
+    }
+    pthread_mutex_unlock(&b->lock);
+    if (found != NULL) {
+        atomic_store_explicit(&found->woken, 1, memory_order_release);
+        futex_wake(&found->woken, 1);
+    }
+    return found != NULL;
+}
+
+/**
+ * @brief Wakes every thread parked on addr.
+ *
+ * @param addr The key the threads parked on.
+ */
+static void lot_unpark_all(const void *addr) {
+    struct lot_bucket *b = lot_bucket(addr);
+    struct parked_thread *woken = NULL;
+    pthread_mutex_lock(&b->lock);
+    struct parked_thread *t = b->head;
+    while (t != NULL) {
+        struct parked_thread *next = t->next;
+        if (t->addr == addr) {
+            lot_remove(b, t);
+            t->next = woken;
+            woken = t;
+        }
+        t = next;
+    }
+    pthread_mutex_unlock(&b->lock);
+    while (woken != NULL) {
+        // The thread may reuse its node as soon as it sees woken set.
+        struct parked_thread *next = woken->next;
+        atomic_store_explicit(&woken->woken, 1, memory_order_release);
+        futex_wake(&woken->woken, 1);
+        woken = next;
+    }
+}
+
+/**
+ * @brief Bits of a one-word lock: held, and threads may be parked on it.
+ */
+#define WORD_LOCKED 1u
+#define WORD_PARKED 2u
+
+/**
+ * @brief Pause-spins a contended word lock tries before parking.
+ */
+#define WORD_SPINS 40
+
+static bool word_lock_validate(void *word) {
+    return atomic_load((atomic_uint *)word) == (WORD_LOCKED | WORD_PARKED);
+}
+
+static void word_lock_handoff(void *word, bool more) {
+    atomic_store((atomic_uint *)word, more ? WORD_PARKED : 0u);
+}
+
+/**
+ * @brief Acquires a one-word lock: a CAS when uncontended, a short spin,
+ *        then parking on the word's address with WORD_PARKED set so the
+ *        holder knows to unpark someone.
+ *
+ * @param word The lock word.
+ */
+static void word_lock(atomic_uint *word) {
+    unsigned w = 0;
+    if (atomic_compare_exchange_strong_explicit(word, &w, WORD_LOCKED, memory_order_acquire,
+                                                memory_order_relaxed)) {
+        return;
+    }
+    for (int spins = 0;;) {
+        w = atomic_load_explicit(word, memory_order_relaxed);
+        if (!(w & WORD_LOCKED)) {
+            // Keep WORD_PARKED: other threads may still be parked.
+            if (atomic_compare_exchange_weak_explicit(word, &w, w | WORD_LOCKED, memory_order_acquire,
+                                                      memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        if (!(w & WORD_PARKED)) {
+            if (spins++ < WORD_SPINS) {
+                cpu_relax();
+                continue;
+            }
+            if (!atomic_compare_exchange_weak_explicit(word, &w, w | WORD_PARKED, memory_order_relaxed,
+                                                       memory_order_relaxed)) {
+                continue;
+            }
+        }
+        lot_park(word, word_lock_validate, NULL, word, NULL);
+    }
+}
+
+/**
+ * @brief Acquires a one-word lock only if it is free.
+ *
+ * @return True if the lock was acquired.
+ */
+static bool word_trylock(atomic_uint *word) {
+    unsigned w = atomic_load_explicit(word, memory_order_relaxed);
+    return !(w & WORD_LOCKED) &&
+           atomic_compare_exchange_strong_explicit(word, &w, w | WORD_LOCKED, memory_order_acquire,
+                                                   memory_order_relaxed);
+}
+
+/**
+ * @brief Releases a one-word lock, unparking one waiter if any is parked.
+ *        The word is rewritten under the bucket lock, so a thread about to
+ *        park either sees the lock free or is found by the unpark.
+ *
+ * @param word The lock word.
+ */
+static void word_unlock(atomic_uint *word) {
+    unsigned w = WORD_LOCKED;
+    if (atomic_compare_exchange_strong_explicit(word, &w, 0, memory_order_release,
+                                                memory_order_relaxed)) {
+        return;
+    }
+    lot_unpark_one(word, word_lock_handoff, word);
+}
+
+/**
+ * @brief Adjusts the item count of the mutex backend. Callers hold q->lock,
+ *        so a relaxed load/store pair is enough; the counter is atomic only
+ *        so try_enqueue/try_dequeue can pre-check it without the lock.
+ *
+ * @param q The queue.
+ * @param delta Number of items added (positive) or removed (negative).
+ */
+static void count_add(queue_t q, int delta) {
+    int count = atomic_load_explicit(&q->count, memory_order_relaxed);
+    atomic_store_explicit(&q->count, count + delta, memory_order_relaxed);
+}
+
+/**
+ * @brief Answers a producer that found the queue full and may not wait:
+ *        under QUEUE_OVERFLOW_REJECT the n items it offered count as
+ *        rejected.
+ *
+ * @param q The queue.
+ * @param n Number of items turned away.
+ * @return QUEUE_FULL.
+ */
+static queue_status_t overflow_reject(queue_t q, int n) {
+    if (q->overflow == QUEUE_OVERFLOW_REJECT) {
+        atomic_fetch_add_explicit(&q->rejected, (size_t)n, memory_order_relaxed);
+    }
+    return QUEUE_FULL;
+}
+
+/**
+ * @brief Current CLOCK_MONOTONIC time in nanoseconds.
+ */
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Maps a time in queue to its histogram bucket: values below 8
+ *        are exact, then each power of two splits into 8 buckets by the
+ *        three bits below its leading one.
+ */
+static int latency_bucket(uint64_t ns) {
+    if (ns < 8) {
+        return (int)ns;
+    }
+    int e = 63 - __builtin_clzll(ns);
+    int bucket = ((e - 2) << 3) + (int)((ns >> (e - 3)) & 7);
+    return bucket < QUEUE_LATENCY_BUCKETS ? bucket : QUEUE_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * @brief Start of a wait on a full (producer) or empty queue for the
+ *        stats block, which counts the thread as blocked: the current
+ *        time, or 0 if the queue keeps no stats, which makes stats_waited
+ *        a no-op. Every non-zero result must reach stats_waited.
+ */
+static uint64_t stats_clock(queue_t q, bool producer) {
+    struct queue_counters *c = q->counters;
+    if (c == NULL) {
+        return 0;
+    }
+    atomic_fetch_add_explicit(producer ? &c->blocked_producers : &c->blocked_consumers, 1,
+                              memory_order_relaxed);
+    return monotonic_ns();
+}
+
+/**
+ * @brief stats_clock for the spin stage of the mutex backend, which only
+ *        waits at all under a wait strategy; without one the clock starts
+ *        when the thread parks.
+ */
+static uint64_t spin_clock(queue_t q, bool producer) {
+    return q->spin_limit > 0 || q->yield_limit > 0 ? stats_clock(q, producer) : 0;
+}
+
+/**
+ * @brief Stats mode: counts a wait on a full (producer) or empty queue
+ *        that started at since, as returned by stats_clock.
+ */
+static void stats_waited(queue_t q, bool producer, uint64_t since) {
+    if (since == 0) {
+        return;
+    }
+    struct queue_counters *c = q->counters;
+    unsigned long long ns = monotonic_ns() - since;
+    if (producer) {
+        atomic_fetch_add_explicit(&c->full_waits, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&c->enqueue_wait_ns, ns, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&c->blocked_producers, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&c->empty_waits, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&c->dequeue_wait_ns, ns, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&c->blocked_consumers, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Stats mode: stamps n slots starting at index as filled now and
+ *        raises the peak occupancy. Called before the items are published.
+ *
+ * @param q The queue, which keeps stats.
+ * @param index Slot of the first item, below capacity.
+ * @param n Number of items.
+ * @param count Occupancy once they are published.
+ */
+static void stats_enqueued(queue_t q, size_t index, size_t n, int count) {
+    struct queue_counters *c = q->counters;
+    uint64_t now = monotonic_ns();
+    for (size_t i = 0; i < n; i++, index++) {
+        q->stamps[index < (size_t)q->capacity ? index : index - (size_t)q->capacity] = now;
+    }
+    atomic_fetch_add_explicit(&c->enqueued, n, memory_order_relaxed);
+    int peak = atomic_load_explicit(&c->peak_count, memory_order_relaxed);
+    if (count > q->capacity) {
+        count = q->capacity;
+    }
+    while (count > peak && !atomic_compare_exchange_weak_explicit(&c->peak_count, &peak, count,
+                                                                  memory_order_relaxed,
+                                                                  memory_order_relaxed)) {
+    }
+}
+
+/**
+ * @brief Stats mode: records how long the n items starting at slot index
+ *        were queued. Called before their slots are handed back.
+ */
+static void stats_dequeued(queue_t q, size_t index, size_t n) {
+    struct queue_counters *c = q->counters;
+    uint64_t now = monotonic_ns();
+    for (size_t i = 0; i < n; i++, index++) {
+        uint64_t stamp = q->stamps[index < (size_t)q->capacity ? index : index - (size_t)q->capacity];
+        int bucket = latency_bucket(now > stamp ? now - stamp : 0);
+        atomic_fetch_add_explicit(&c->latency[bucket], 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&c->dequeued, n, memory_order_relaxed);
+}
+
+#ifdef QUEUE_LOCK_PROFILE
+/**
+ * @brief Adds one sample to a total and its maximum.
+ */
+static void prof_sample(uint64_t *total, uint64_t *max, uint64_t ns) {
+    *total += ns;
+    if (ns > *max) {
+        *max = ns;
+    }
+}
+
+/**
+ * @brief Books a lock acquisition at site that was asked for at start and
+ *        starts timing the hold. Called with q->lock just taken.
+ */
+static void prof_acquired(queue_t q, enum lock_site site, uint64_t start, bool contended) {
+    uint64_t now = monotonic_ns();
+    struct lock_site_stats *s = &q->profile.sites[site];
+    s->acquires++;
+    s->contended += contended;
+    prof_sample(&s->acquire_ns, &s->acquire_max_ns, now - start);
+    q->profile.site = site;
+    q->profile.acquired_at = now;
+}
+
+/**
+ * @brief Books the end of the current hold. Called with q->lock held,
+ *        right before it is released or a wait releases it.
+ */
+static void prof_released(queue_t q) {
+    struct lock_site_stats *s = &q->profile.sites[q->profile.site];
+    prof_sample(&s->hold_ns, &s->hold_max_ns, monotonic_ns() - q->profile.acquired_at);
+}
+
+/**
+ * @brief pthread_mutex_lock that tries first, so it can tell a contended
+ *        acquisition from a free one.
+ */
+static void prof_lock(queue_t q, enum lock_site site) {
+    uint64_t start = monotonic_ns();
+    bool contended = pthread_mutex_trylock(&q->lock) != 0;
+    if (contended) {
+        pthread_mutex_lock(&q->lock);
+    }
+    prof_acquired(q, site, start, contended);
+}
+
+static int prof_trylock(queue_t q, enum lock_site site) {
+    uint64_t start = monotonic_ns();
+    int err = pthread_mutex_trylock(&q->lock);
+    if (err != 0) {
+        atomic_fetch_add_explicit(&q->profile.sites[site].trylock_failures, 1, memory_order_relaxed);
+        return err;
+    }
+    prof_acquired(q, site, start, false);
+    return 0;
+}
+
+static void prof_unlock(queue_t q) {
+    prof_released(q);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * @brief Notes that a wake-up is being sent on cond. Called with q->lock
+ *        held.
+ */
+static void prof_signaled(queue_t q, pthread_cond_t *cond) {
+    q->profile.signaled_at[cond == &q->not_empty] = monotonic_ns();
+}
+
+/**
+ * @brief A waiter about to release q->lock in a condition wait: ends the
+ *        hold and remembers the site and the time the wait began.
+ */
+struct prof_wait {
+    enum lock_site site;
+    uint64_t since;
+};
+
+static struct prof_wait prof_wait_begin(queue_t q) {
+    prof_released(q);
+    return (struct prof_wait){q->profile.site, monotonic_ns()};
+}
+
+/**
+ * @brief A waiter running again with q->lock: a wait a signal ended counts
+ *        its wake-to-run latency, which includes taking the lock back and
+ *        so shows convoys after a broadcast. Starts the next hold.
+ */
+static void prof_wait_end(queue_t q, const struct prof_wait *wait, pthread_cond_t *cond,
+                          bool timed_out) {
+    uint64_t now = monotonic_ns();
+    struct lock_site_stats *s = &q->profile.sites[wait->site];
+    uint64_t signaled = q->profile.signaled_at[cond == &q->not_empty];
+    if (!timed_out && signaled >= wait->since) {
+        s->wakeups++;
+        prof_sample(&s->wake_ns, &s->wake_max_ns, now - signaled);
+    }
+    q->profile.site = wait->site;
+    q->profile.acquired_at = now;
+}
+
+/**
+ * @brief Lock operations on q->lock. With -DQUEUE_LOCK_PROFILE they feed
+ *        the lock profiler, booking the time under site; otherwise they
+ *        are the bare pthread calls and site is never evaluated.
+ */
+#define queue_lock(q, site) prof_lock(q, site)
+#define queue_trylock(q, site) prof_trylock(q, site)
+#define queue_unlock(q) prof_unlock(q)
+#define lock_signaled(q, cond) prof_signaled(q, cond)
+#else
+#define queue_lock(q, site) pthread_mutex_lock(&(q)->lock)
+#define queue_trylock(q, site) pthread_mutex_trylock(&(q)->lock)
+#define queue_unlock(q) pthread_mutex_unlock(&(q)->lock)
+#define lock_signaled(q, cond) ((void)0)
+#endif
+
+/**
+ * @brief Parks the calling thread on cond for the mutex backend, keeping
+ *        the waiter bookkeeping in w up to date. Called with q->lock held.
+ *        In futex mode the thread instead snapshots w->futex under the lock
+ *        and sleeps on it with the lock released; any waker bumps the word
+ *        under the lock first, so a wake-up between the unlock and the
+ *        futex call makes the kernel return at once instead of being lost.
+ *
+ * @param q The queue.
+ * @param cond The condition variable to park on.
+ * @param w The bookkeeping paired with cond.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return True if the deadline passed.
+ */
+static bool park(queue_t q, pthread_cond_t *cond, struct waiters *w,
+                 const struct timespec *deadline) {
+    bool timed_out;
+    w->sleeping++;
+    probe_blocked(q, cond == &q->not_full);
+#ifdef QUEUE_LOCK_PROFILE
+    struct prof_wait wait = prof_wait_begin(q);
+#endif
+    if (q->parking == QUEUE_PARK_FUTEX) {
+        unsigned seq = atomic_load_explicit(&w->futex, memory_order_relaxed);
+        pthread_mutex_unlock(&q->lock);
+        timed_out = futex_wait_until(&w->futex, seq, deadline);
+        pthread_mutex_lock(&q->lock);
+    } else {
+        timed_out = cond_wait_until(cond, &q->lock, deadline);
+    }
+#ifdef QUEUE_LOCK_PROFILE
+    prof_wait_end(q, &wait, cond, timed_out);
+#endif
+    probe_woken(q, cond == &q->not_full, timed_out);
+    w->sleeping--;
+    // Whatever woke us (signal, timeout or spurious) retires one pending
+    // wake-up; over-retiring only makes the next waker signal once more.
+    if (w->signaled > 0) {
+        w->signaled--;
+    }
+    if (w->signaled > w->sleeping) {
+        w->signaled = w->sleeping;
+    }
+    return timed_out;
+}
+
+/**
+ * @brief Wakes up to n threads parked on cond, but never more than are
+ *        asleep without a wake-up already on its way. Makes no call at all
+ *        when nobody is waiting, so in futex mode only the empty->non-empty
+ *        and full->non-full transitions that someone is parked on reach the
+ *        kernel. Called with q->lock held.
+ *
+ * @param q The queue.
+ * @param cond The condition variable to signal.
+ * @param w The bookkeeping paired with cond.
+ * @param n Number of items or slots that just became available.
+ */
+static void unpark(queue_t q, pthread_cond_t *cond, struct waiters *w, int n) {
+    int idle = w->sleeping - w->signaled;
+    if (n > idle) {
+        n = idle;
+    }
+    if (n <= 0) {
+        return;
+    }
+    w->signaled += n;
+    lock_signaled(q, cond);
+    if (q->parking == QUEUE_PARK_FUTEX) {
+        atomic_fetch_add_explicit(&w->futex, 1, memory_order_relaxed);
+        futex_wake(&w->futex, n);
+        return;
+    }
+    if (w->signaled == w->sleeping) {
+        pthread_cond_broadcast(cond); // Everyone asleep gets work: one call.
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_cond_signal(cond);
+    }
+}
+
+/**
+ * @brief Smallest run of dequeued ring memory worth handing back to the
+ *        kernel when a lazy queue drains; below it the madvise call and the
+ *        refaults cost more than the memory is worth.
+ */
+#define LAZY_TRIM_BYTES (256 * 1024)
+
+/**
+ * @brief Lazy mode bookkeeping after n items left the ring. Once the queue
+ *        has drained and consumers moved past at least LAZY_TRIM_BYTES since
+ *        the last trim, every page except the one under head (where the
+ *        next enqueue writes) is returned with MADV_DONTNEED, so it costs
+ *        no memory until a burst touches it again. Called with q->lock
+ *        held, which keeps producers from writing into a page being dropped.
+ *
+ * @param q The queue.
+ * @param n Number of items just dequeued.
+ */
+static void lazy_dequeued(queue_t q, int n) {
+    size_t elem = q->elem_size != 0 ? q->elem_size : sizeof(void *);
+    q->since_trim += (size_t)n;
+    if (atomic_load_explicit(&q->count, memory_order_relaxed) != 0 ||
+        q->since_trim * elem < LAZY_TRIM_BYTES) {
+        return;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t at = (size_t)q->head * elem;
+    size_t keep_lo = at / page * page;
+    size_t keep_hi = (at + elem + page - 1) / page * page;
+    unsigned char *base = q->mapping;
+    if (keep_lo > 0) {
+        madvise(base, keep_lo, MADV_DONTNEED);
+    }
+    if (keep_hi < q->mapping_bytes) {
+        madvise(base + keep_hi, q->mapping_bytes - keep_hi, MADV_DONTNEED);
+    }
+    q->since_trim = 0;
+}
+
+/**
+ * @brief Internal helper function to handle shutdown signaling.
+ *        Sets the shutdown flag and broadcasts to both condition variables
+ *        to ensure all waiting producer and consumer threads are woken up.
+ *
+ * @param q The queue to signal shutdown on.
+ */
+static void signal_shutdown(queue_t q) {
+    QUEUE_PROBE1("shutdown", PROBE_VAL(q));
+    // Set shutdown flag to true so waiting threads can know to exit.
+    q->shutdown = true;
+    // Wake up all threads waiting on not_full (producers) and not_empty (consumers).
+    lock_signaled(q, &q->not_full);
+    lock_signaled(q, &q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_cond_broadcast(&q->not_empty);
+    // Futex sleepers (including consumers of the lossy ring) re-check once
+    // their word moves.
+    if (q->parking == QUEUE_PARK_FUTEX || q->cells != NULL) {
+        atomic_fetch_add_explicit(&q->producers.futex, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&q->consumers.futex, 1, memory_order_relaxed);
+        futex_wake(&q->producers.futex, INT_MAX);
+        futex_wake(&q->consumers.futex, INT_MAX);
+    }
+}
+
+/**
+ * @brief Returns true if the SPSC or MPMC ring holds no items.
+ *        On the MPMC ring a slot claimed by a producer that has not
+ *        published yet already counts as an item.
+ *
+ * @param q The queue.
+ */
+static bool ring_empty(queue_t q) {
+    return atomic_load(&q->ring_tail) == atomic_load(&q->ring_head);
+}
+
+/**
+ * @brief Approximate number of items in the SPSC or MPMC ring, counting
+ *        claimed slots like ring_empty, clamped to [0, capacity] since the
+ *        two positions are read one after the other.
+ */
+static int ring_count(queue_t q) {
+    size_t head = atomic_load(&q->ring_head);
+    ptrdiff_t used = (ptrdiff_t)(atomic_load(&q->ring_tail) - head);
+    return used < 0 ? 0 : used > q->capacity ? q->capacity : (int)used;
+}
+
+/**
+ * @brief Moves the adaptive spin budget an eighth of the way toward target,
+ *        staying between SPIN_FLOOR and the configured limit.
+ *
+ * @param q The queue.
+ * @param target Budget suggested by the wait that just finished.
+ */
+static void spin_adapt(queue_t q, int target) {
+    int budget = atomic_load_explicit(&q->spin_budget, memory_order_relaxed);
+    int floor = q->spin_limit < SPIN_FLOOR ? q->spin_limit : SPIN_FLOOR;
+    budget += (target - budget) / 8;
+    if (budget > q->spin_limit) {
+        budget = q->spin_limit;
+    }
+    if (budget < floor) {
+        budget = floor;
+    }
+    atomic_store_explicit(&q->spin_budget, budget, memory_order_relaxed);
+}
+
+/**
+ * @brief First stages of the wait strategy, run before a thread parks:
+ *        pause-spin for the spin budget, then sched_yield for yield_limit
+ *        rounds, re-checking ready() without any lock in between. With the
+ *        adaptive strategy a wait that succeeds while spinning pulls the
+ *        budget toward twice the spins it needed; one that only succeeds
+ *        while yielding pulls it toward the limit; one that ends up parking
+ *        pulls it toward the floor.
+ *
+ * @param q The queue.
+ * @param ready Predicate that returns true once the caller can proceed.
+ * @param need Number of items or free slots the caller is waiting for.
+ * @return True if ready() or shutdown turned true, so parking is not needed.
+ */
+static bool spin_wait(queue_t q, bool (*ready)(queue_t, size_t), size_t need) {
+    if (q->spin_limit == 0 && q->yield_limit == 0) {
+        return false;
+    }
+    int budget = q->spin_adaptive
+        ? atomic_load_explicit(&q->spin_budget, memory_order_relaxed)
+        : q->spin_limit;
+    for (int i = 0; i < budget; i++) {
+        if (ready(q, need) || atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+            if (q->spin_adaptive) {
+                spin_adapt(q, 2 * i);
+            }
+            return true;
+        }
+        cpu_relax();
+    }
+    for (int i = 0; i < q->yield_limit; i++) {
+        sched_yield();
+        if (ready(q, need) || atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+            if (q->spin_adaptive) {
+                spin_adapt(q, q->spin_limit);
+            }
+            return true;
+        }
+    }
+    if (q->spin_adaptive) {
+        spin_adapt(q, 0);
+    }
+    return false;
+}
+
+static bool mutex_not_full(queue_t q, size_t need) {
+    int count = atomic_load_explicit(&q->count, memory_order_relaxed);
+    return (size_t)(q->capacity - count) >= need;
+}
+
+static bool mutex_not_empty(queue_t q, size_t need) {
+    return (size_t)atomic_load_explicit(&q->count, memory_order_relaxed) >= need;
+}
+
+/**
+ * @brief Slow path for the lock-free backends: after the spin and yield
+ *        stages of the wait strategy, parks the calling thread on cond
+ *        until ready() reports progress or shutdown is called.
+ *        The waiter count is bumped before every re-check so the other side
+ *        either sees it (and signals) or the re-check sees the other side's
+ *        update; no wake-up can be lost in between.
+ *
+ * @param q The queue.
+ * @param cond The condition variable to park on.
+ * @param waiting Count of parked threads that have not been signaled yet.
+ * @param ready Predicate that returns true once the caller can proceed.
+ * @param need Number of items or free slots the caller is waiting for.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return True if the deadline passed before ready() reported progress.
+ */
+static bool ring_wait(queue_t q, pthread_cond_t *cond, atomic_int *waiting,
+                      bool (*ready)(queue_t, size_t), size_t need,
+                      const struct timespec *deadline) {
+    uint64_t since = stats_clock(q, cond == &q->not_full);
+    if (spin_wait(q, ready, need)) {
+        stats_waited(q, cond == &q->not_full, since);
+        return false;
+    }
+    bool timed_out = false;
+    queue_lock(q, cond == &q->not_full ? LOCK_ENQUEUE : LOCK_DEQUEUE);
+    while (!q->shutdown && !timed_out) {
+        atomic_fetch_add(waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        // A stale increment left behind by this early exit only costs the
+        // other side one spare signal; it is never undone here because
+        // that could steal the count of a thread that really is asleep.
+        if (ready(q, need)) {
+            break;
+        }
+        probe_blocked(q, cond == &q->not_full);
+#ifdef QUEUE_LOCK_PROFILE
+        struct prof_wait wait = prof_wait_begin(q);
+#endif
+        timed_out = cond_wait_until(cond, &q->lock, deadline);
+#ifdef QUEUE_LOCK_PROFILE
+        prof_wait_end(q, &wait, cond, timed_out);
+#endif
+        probe_woken(q, cond == &q->not_full, timed_out);
+        timed_out = timed_out && !ready(q, need);
+    }
+    queue_unlock(q);
+    stats_waited(q, cond == &q->not_full, since);
+    return timed_out;
+}
+
+/**
+ * @brief Wakes one thread parked in ring_wait() on cond, if there is one.
+ *        The waker consumes one unit of the waiter count, so a thread that
+ *        stays parked while the other side keeps running is signaled once
+ *        rather than on every operation. Costs a fence and a load when
+ *        nobody is parked.
+ *
+ * @param q The queue.
+ * @param cond The condition variable to signal.
+ * @param waiting Count of parked threads that have not been signaled yet.
+ */
+static void ring_wake(queue_t q, pthread_cond_t *cond, atomic_int *waiting) {
+    atomic_thread_fence(memory_order_seq_cst);
+    int parked = atomic_load_explicit(waiting, memory_order_relaxed);
+    while (parked > 0 && !atomic_compare_exchange_weak(waiting, &parked, parked - 1)) {
+    }
+    if (parked > 0) {
+        queue_lock(q, cond == &q->not_empty ? LOCK_ENQUEUE : LOCK_DEQUEUE);
+        lock_signaled(q, cond);
+        pthread_cond_signal(cond);
+        queue_unlock(q);
+    }
+}
+
+static bool spsc_not_full(queue_t q, size_t need) {
+    size_t used = atomic_load(&q->ring_tail) - atomic_load(&q->ring_head);
+    return (size_t)q->capacity - used >= need;
+}
+
+static bool spsc_not_empty(queue_t q, size_t need) {
+    return atomic_load(&q->ring_tail) - atomic_load(&q->ring_head) >= need;
+}
+
+/**
+ * @brief Number of slots that can be addressed contiguously from the start
+ *        of the ring: twice the capacity when it is mirrored, so no run of
+ *        up to capacity slots ever needs to wrap.
+ */
+static inline size_t ring_run(queue_t q) {
+    return q->mirrored ? 2 * (size_t)q->capacity : (size_t)q->capacity;
+}
+
+/**
+ * @brief Copies n items into the circular array starting at index, using at
+ *        most two memcpy calls around the wrap point.
+ *
+ * @param ring The circular array.
+ * @param capacity Number of slots addressable contiguously (see ring_run).
+ * @param index First slot to write.
+ * @param items The items to copy in.
+ * @param n Number of items, at most capacity.
+ */
+static void ring_copy_in(void **ring, size_t capacity, size_t index,
+                         void *const *items, size_t n) {
+    size_t first = capacity - index < n ? capacity - index : n;
+    memcpy(ring + index, items, first * sizeof(void *));
+    memcpy(ring, items + first, (n - first) * sizeof(void *));
+}
+
+/**
+ * @brief Copies n items out of the circular array starting at index, using
+ *        at most two memcpy calls around the wrap point.
+ *
+ * @param ring The circular array.
+ * @param capacity Number of slots addressable contiguously (see ring_run).
+ * @param index First slot to read.
+ * @param out Where to copy the items.
+ * @param n Number of items, at most capacity.
+ */
+static void ring_copy_out(void *const *ring, size_t capacity, size_t index,
+                          void **out, size_t n) {
+    size_t first = capacity - index < n ? capacity - index : n;
+    memcpy(out, ring + index, first * sizeof(void *));
+    memcpy(out + first, ring, (n - first) * sizeof(void *));
+}
+
+/**
+ * @brief SPSC enqueue. Only the single producer thread may call this.
+ *        The slot is written before ring_tail is released, so the consumer
+ *        never observes a position whose item is not yet visible.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @param deadline When to stop waiting for a free slot (see NO_WAIT).
+ * @param pow2 Whether the capacity is a power of two (a constant).
+ * @return QUEUE_OK, QUEUE_SHUTDOWN, or if the ring stays full QUEUE_FULL
+ *         (NO_WAIT or QUEUE_OVERFLOW_REJECT) or QUEUE_TIMEOUT.
+ */
+static ALWAYS_INLINE queue_status_t spsc_enqueue(queue_t q, void *data,
+                                                 const struct timespec *deadline, const bool pow2) {
+    size_t tail = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+    // Items offered after shutdown are dropped, same as the mutex backend.
+    if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+        return QUEUE_SHUTDOWN;
+    }
+    // Only reload the consumer's index when our cached copy says we are full.
+    if (tail - q->cached_head == (size_t)q->capacity) {
+        q->cached_head = atomic_load_explicit(&q->ring_head, memory_order_acquire);
+        if (tail - q->cached_head == (size_t)q->capacity) {
+            if (deadline == NO_WAIT || q->overflow == QUEUE_OVERFLOW_REJECT) {
+                return overflow_reject(q, 1);
+            }
+            bool timed_out = ring_wait(q, &q->not_full, &q->waiting_producers,
+                                       spsc_not_full, 1, deadline);
+            if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+                return QUEUE_SHUTDOWN;
+            }
+            if (timed_out) {
+                return QUEUE_TIMEOUT;
+            }
+            q->cached_head = atomic_load_explicit(&q->ring_head, memory_order_acquire);
+        }
+    }
+    size_t index = ring_slot(q, tail, pow2);
+    q->buffer[index] = data;
+    if (q->counters != NULL) {
+        stats_enqueued(q, index, 1, ring_count(q) + 1);
+    }
+    atomic_store_explicit(&q->ring_tail, tail + 1, memory_order_release);
+    probe_ring("enqueue", q, 1);
+    ring_wake(q, &q->not_empty, &q->waiting_consumers);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief SPSC dequeue. Only the single consumer thread may call this.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data (a void **).
+ * @param deadline When to stop waiting for an item (see NO_WAIT).
+ * @param pow2 Whether the capacity is a power of two (a constant).
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once the queue is shutdown and drained,
+ *         or if the ring stays empty QUEUE_EMPTY (NO_WAIT) or QUEUE_TIMEOUT.
+ */
+static ALWAYS_INLINE queue_status_t spsc_dequeue(queue_t q, void *out,
+                                                 const struct timespec *deadline, const bool pow2) {
+    size_t head = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+    // Only reload the producer's index when our cached copy says we are empty.
+    if (head == q->cached_tail) {
+        q->cached_tail = atomic_load_explicit(&q->ring_tail, memory_order_acquire);
+        if (head == q->cached_tail) {
+            if (atomic_load(&q->shutdown)) {
+                return QUEUE_SHUTDOWN;
+            }
+            if (deadline == NO_WAIT) {
+                return QUEUE_EMPTY;
+            }
+            bool timed_out = ring_wait(q, &q->not_empty, &q->waiting_consumers,
+                                       spsc_not_empty, 1, deadline);
+            q->cached_tail = atomic_load_explicit(&q->ring_tail, memory_order_acquire);
+            if (head == q->cached_tail) {
+                // Woken by shutdown with nothing left to drain, or out of time.
+                return timed_out ? QUEUE_TIMEOUT : QUEUE_SHUTDOWN;
+            }
+        }
+    }
+    size_t index = ring_slot(q, head, pow2);
+    *(void **)out = q->buffer[index];
+    if (q->counters != NULL) {
+        stats_dequeued(q, index, 1);
+    }
+    atomic_store_explicit(&q->ring_head, head + 1, memory_order_release);
+    probe_ring("dequeue", q, 1);
+    ring_wake(q, &q->not_full, &q->waiting_producers);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief SPSC batch enqueue. Each round copies every item that fits into
+ *        the free run of the ring and publishes them with one store.
+ *
+ * @param q The queue.
+ * @param items The items to add.
+ * @param n Number of items.
+ * @return Number of items enqueued; fewer than n only after shutdown or
+ *         when QUEUE_OVERFLOW_REJECT refused the rest.
+ */
+static int spsc_enqueue_batch(queue_t q, void **items, int n) {
+    size_t cap = (size_t)q->capacity;
+    size_t tail = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+    int done = 0;
+    while (done < n) {
+        if (tail - q->cached_head == cap) {
+            q->cached_head = atomic_load_explicit(&q->ring_head, memory_order_acquire);
+            if (tail - q->cached_head == cap) {
+                if (q->overflow == QUEUE_OVERFLOW_REJECT) {
+                    overflow_reject(q, n - done);
+                    break;
+                }
+                ring_wait(q, &q->not_full, &q->waiting_producers, spsc_not_full, 1, NULL);
+                q->cached_head = atomic_load_explicit(&q->ring_head, memory_order_acquire);
+            }
+        }
+        if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+            break;
+        }
+        size_t k = cap - (tail - q->cached_head);
+        if (k > (size_t)(n - done)) {
+            k = (size_t)(n - done);
+        }
+        ring_copy_in(q->buffer, ring_run(q), ring_index(q, tail), items + done, k);
+        if (q->counters != NULL) {
+            stats_enqueued(q, ring_index(q, tail), k, ring_count(q) + (int)k);
+        }
+        tail += k;
+        atomic_store_explicit(&q->ring_tail, tail, memory_order_release);
+        probe_ring("enqueue", q, k);
+        ring_wake(q, &q->not_empty, &q->waiting_consumers);
+        done += (int)k;
+    }
+    return done;
+}
+
+/**
+ * @brief SPSC batch dequeue. Waits for min items, then takes up to max in
+ *        one copy and frees their slots with one store.
+ *
+ * @param q The queue.
+ * @param out Where to store the items.
+ * @param max Maximum number of items to take.
+ * @param min Number of items to wait for, already clamped to [0, max].
+ * @return Number of items dequeued.
+ */
+static int spsc_dequeue_batch(queue_t q, void **out, int max, int min) {
+    size_t head = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+    if (q->cached_tail - head < (size_t)max) {
+        q->cached_tail = atomic_load_explicit(&q->ring_tail, memory_order_acquire);
+    }
+    if (q->cached_tail - head < (size_t)min) {
+        ring_wait(q, &q->not_empty, &q->waiting_consumers, spsc_not_empty, (size_t)min, NULL);
+        q->cached_tail = atomic_load_explicit(&q->ring_tail, memory_order_acquire);
+    }
+    size_t k = q->cached_tail - head;
+    if (k > (size_t)max) {
+        k = (size_t)max;
+    }
+    if (k == 0) {
+        return 0;
+    }
+    ring_copy_out(q->buffer, ring_run(q), ring_index(q, head), out, k);
+    if (q->counters != NULL) {
+        stats_dequeued(q, ring_index(q, head), k);
+    }
+    atomic_store_explicit(&q->ring_head, head + k, memory_order_release);
+    probe_ring("dequeue", q, k);
+    ring_wake(q, &q->not_full, &q->waiting_producers);
+    return (int)k;
+}
+
+/**
+ * @brief Returns how far the slot at pos is from holding lap value want.
+ *        Zero means ready, negative means the slot still belongs to the
+ *        previous lap, positive means another thread already moved past pos.
+ *
+ * @param slot The slot mapped to pos.
+ * @param want The sequence number the caller is waiting for.
+ */
+static long slot_lag(struct ring_slot *slot, size_t want) {
+    return (long)(atomic_load_explicit(&slot->seq, memory_order_acquire) - want);
+}
+
+static bool mpmc_not_full(queue_t q, size_t need) {
+    (void)need; // Slots are claimed one at a time.
+    size_t tail = atomic_load(&q->ring_tail);
+    return slot_lag(&q->slots[ring_index(q, tail)], 2 * tail) >= 0;
+}
+
+static bool mpmc_not_empty(queue_t q, size_t need) {
+    (void)need; // Items are claimed one at a time.
+    size_t head = atomic_load(&q->ring_head);
+    return slot_lag(&q->slots[ring_index(q, head)], 2 * head + 1) >= 0;
+}
+
+static ALWAYS_INLINE queue_status_t mpmc_dequeue(queue_t q, void *out,
+                                                 const struct timespec *deadline, const bool pow2);
+
+/**
+ * @brief MPMC enqueue. Producers race for ring_tail with a CAS; the winner
+ *        owns the slot until it publishes the item by bumping the slot's
+ *        sequence number. No global lock is taken unless the ring is full.
+ *        Under QUEUE_OVERFLOW_EVICT a producer facing a full ring dequeues
+ *        the oldest item itself and tries again.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @param deadline When to stop waiting for a free slot (see NO_WAIT).
+ * @param pow2 Whether the capacity is a power of two (a constant).
+ * @return QUEUE_OK, QUEUE_SHUTDOWN, or if the ring stays full QUEUE_FULL
+ *         (NO_WAIT or QUEUE_OVERFLOW_REJECT) or QUEUE_TIMEOUT.
+ */
+static ALWAYS_INLINE queue_status_t mpmc_enqueue(queue_t q, void *data,
+                                                 const struct timespec *deadline, const bool pow2) {
+    size_t pos = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+    struct ring_slot *slot;
+    for (;;) {
+        // Items offered after shutdown are dropped, same as the mutex backend.
+        if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+            return QUEUE_SHUTDOWN;
+        }
+        slot = &q->slots[ring_slot(q, pos, pow2)];
+        long lag = slot_lag(slot, 2 * pos);
+        if (lag == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->ring_tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // The slot still holds last lap's item: the ring is full.
+            if (q->overflow == QUEUE_OVERFLOW_EVICT) {
+                // Take the oldest item out like a consumer would, then retry.
+                void *old;
+                if (mpmc_dequeue(q, &old, NO_WAIT, pow2) == QUEUE_OK) {
+                    atomic_fetch_add_explicit(&q->evicted, 1, memory_order_relaxed);
+                    if (q->evict != NULL) {
+                        q->evict(old, q->evict_arg);
+                    }
+                }
+                pos = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+                continue;
+            }
+            if (deadline == NO_WAIT || q->overflow == QUEUE_OVERFLOW_REJECT) {
+                return overflow_reject(q, 1);
+            }
+            if (ring_wait(q, &q->not_full, &q->waiting_producers, mpmc_not_full, 1, deadline)) {
+                return QUEUE_TIMEOUT;
+            }
+            pos = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+        }
+    }
+    slot->data = data;
+    if (q->counters != NULL) {
+        stats_enqueued(q, ring_slot(q, pos, pow2), 1, ring_count(q));
+    }
+    atomic_store_explicit(&slot->seq, 2 * pos + 1, memory_order_release);
+    probe_ring("enqueue", q, 1);
+    ring_wake(q, &q->not_empty, &q->waiting_consumers);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief MPMC dequeue. Consumers race for ring_head with a CAS and hand the
+ *        slot to the producers' next lap once the item has been read.
+ *        After shutdown an item whose producer claimed a slot but had not
+ *        yet published it is not waited for.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data (a void **).
+ * @param deadline When to stop waiting for an item (see NO_WAIT).
+ * @param pow2 Whether the capacity is a power of two (a constant).
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once the queue is shutdown and drained,
+ *         or if the ring stays empty QUEUE_EMPTY (NO_WAIT) or QUEUE_TIMEOUT.
+ */
+static ALWAYS_INLINE queue_status_t mpmc_dequeue(queue_t q, void *out,
+                                                 const struct timespec *deadline, const bool pow2) {
+    size_t pos = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+    struct ring_slot *slot;
+    for (;;) {
+        slot = &q->slots[ring_slot(q, pos, pow2)];
+        long lag = slot_lag(slot, 2 * pos + 1);
+        if (lag == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // Nothing published at pos yet: the ring is empty.
+            if (atomic_load(&q->shutdown)) {
+                return QUEUE_SHUTDOWN;
+            }
+            if (deadline == NO_WAIT) {
+                return QUEUE_EMPTY;
+            }
+            if (ring_wait(q, &q->not_empty, &q->waiting_consumers, mpmc_not_empty, 1, deadline)) {
+                return QUEUE_TIMEOUT;
+            }
+            pos = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+        } else {
+            pos = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+        }
+    }
+    *(void **)out = slot->data;
+    if (q->counters != NULL) {
+        stats_dequeued(q, ring_slot(q, pos, pow2), 1);
+    }
+    atomic_store_explicit(&slot->seq, 2 * (pos + (size_t)q->capacity), memory_order_release);
+    probe_ring("dequeue", q, 1);
+    ring_wake(q, &q->not_full, &q->waiting_producers);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Specializations of the lock-free per-item paths: _mask for
+ *        power-of-two capacities, _mod for the rest.
+ */
+static queue_status_t spsc_enqueue_mask(queue_t q, void *data, const struct timespec *deadline) {
+    return spsc_enqueue(q, data, deadline, true);
+}
+
+static queue_status_t spsc_enqueue_mod(queue_t q, void *data, const struct timespec *deadline) {
+    return spsc_enqueue(q, data, deadline, false);
+}
+
+static queue_status_t spsc_dequeue_mask(queue_t q, void *out, const struct timespec *deadline) {
+    return spsc_dequeue(q, out, deadline, true);
+}
+
+static queue_status_t spsc_dequeue_mod(queue_t q, void *out, const struct timespec *deadline) {
+    return spsc_dequeue(q, out, deadline, false);
+}
+
+static queue_status_t mpmc_enqueue_mask(queue_t q, void *data, const struct timespec *deadline) {
+    return mpmc_enqueue(q, data, deadline, true);
+}
+
+static queue_status_t mpmc_enqueue_mod(queue_t q, void *data, const struct timespec *deadline) {
+    return mpmc_enqueue(q, data, deadline, false);
+}
+
+static queue_status_t mpmc_dequeue_mask(queue_t q, void *out, const struct timespec *deadline) {
+    return mpmc_dequeue(q, out, deadline, true);
+}
+
+static queue_status_t mpmc_dequeue_mod(queue_t q, void *out, const struct timespec *deadline) {
+    return mpmc_dequeue(q, out, deadline, false);
+}
+
+/**
+ * @brief Batch enqueue through the per-item op, for backends with no run
+ *        to copy: MPMC slots are sequenced one by one, and the lossy ring
+ *        and byte-bounded queues account for every item on its own. Not
+ *        atomic: each item takes its own turn and wake-up.
+ */
+static int per_item_enqueue_batch(queue_t q, void **items, int n) {
+    int done = 0;
+    queue_status_t status = QUEUE_OK;
+    while (done < n && (status = q->ops->enqueue(q, items[done], NULL)) == QUEUE_OK) {
+        done++;
+    }
+    // The item that met a full ring was counted; so are the ones behind it.
+    if (status == QUEUE_FULL) {
+        overflow_reject(q, n - done - 1);
+    }
+    return done;
+}
+
+/**
+ * @brief Batch dequeue through the per-item op, for the same backends as
+ *        per_item_enqueue_batch. Blocks for the first min items, then
+ *        takes whatever else is ready.
+ */
+static int per_item_dequeue_batch(queue_t q, void **out, int max, int min) {
+    int done = 0;
+    while (done < max &&
+           q->ops->dequeue(q, &out[done], done < min ? NULL : NO_WAIT) == QUEUE_OK) {
+        done++;
+    }
+    return done;
+}
+
+static bool lossy_not_empty(queue_t q, size_t need) {
+    (void)need; // Items are claimed one at a time.
+    return !ring_empty(q);
+}
+
+/**
+ * @brief Parks a consumer of the lossy ring until head moves away from
+ *        tail, the deadline passes or shutdown. Consumers sleep on the
+ *        consumers futex word rather than a condition variable, so waking
+ *        them never makes a producer wait for the queue lock.
+ *
+ * @param q The queue.
+ * @param head The ring_head the caller found equal to ring_tail.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return True if the deadline passed with the ring still empty.
+ */
+static bool lossy_wait(queue_t q, size_t head, const struct timespec *deadline) {
+    if (spin_wait(q, lossy_not_empty, 1)) {
+        return false;
+    }
+    // Announce the sleeper before the last check, as ring_wait does.
+    atomic_fetch_add(&q->waiting_consumers, 1);
+    unsigned seq = atomic_load(&q->consumers.futex);
+    bool timed_out = false;
+    if (atomic_load(&q->ring_tail) == head && !atomic_load(&q->shutdown)) {
+        probe_blocked(q, false);
+        timed_out = futex_wait_until(&q->consumers.futex, seq, deadline) && ring_empty(q);
+        probe_woken(q, false, timed_out);
+    }
+    atomic_fetch_sub(&q->waiting_consumers, 1);
+    return timed_out;
+}
+
+/**
+ * @brief Lossy ring enqueue (QUEUE_OVERFLOW_OVERWRITE). Wait-free: the
+ *        producer claims a position with one fetch_add and swaps its item
+ *        into that position's cell, so it never waits for a consumer, a
+ *        lock or another producer. An item the swap pushes out was not
+ *        taken within a lap and goes to the eviction callback. Sleeping
+ *        consumers are woken with a futex syscall, not under a lock.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @param deadline Unused: the lossy ring never waits.
+ * @param pow2 Whether the capacity is a power of two (a constant).
+ * @return QUEUE_OK, or QUEUE_SHUTDOWN.
+ */
+static ALWAYS_INLINE queue_status_t lossy_enqueue(queue_t q, void *data,
+                                                  const struct timespec *deadline, const bool pow2) {
+    (void)deadline;
+    if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+        return QUEUE_SHUTDOWN;
+    }
+    size_t pos = atomic_fetch_add_explicit(&q->ring_tail, 1, memory_order_relaxed);
+    struct lossy_cell *cell = &q->cells[ring_slot(q, pos, pow2)];
+    void *old = atomic_exchange_explicit(&cell->item, data, memory_order_acq_rel);
+    atomic_fetch_add_explicit(&cell->stored, 1, memory_order_release);
+    probe_ring("enqueue", q, 1);
+    if (old != NULL) {
+        atomic_fetch_add_explicit(&q->evicted, 1, memory_order_relaxed);
+        if (q->evict != NULL) {
+            q->evict(old, q->evict_arg);
+        }
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->waiting_consumers, memory_order_relaxed) > 0) {
+        atomic_fetch_add_explicit(&q->consumers.futex, 1, memory_order_relaxed);
+        futex_wake(&q->consumers.futex, 1);
+    }
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Takes an item out of any cell of the lossy ring. Every position
+ *        has been claimed when a shutdown queue looks drained, so an item
+ *        still in a cell was swapped in late by a producer whose position
+ *        consumers had already passed, and nobody else will take it.
+ *
+ * @param q The queue.
+ * @return The item, or NULL if every cell is empty.
+ */
+static void *lossy_stranded(queue_t q) {
+    for (int i = 0; i < q->capacity; i++) {
+        struct lossy_cell *cell = &q->cells[i];
+        if (atomic_load_explicit(&cell->item, memory_order_relaxed) != NULL) {
+            void *item = atomic_exchange_explicit(&cell->item, NULL, memory_order_acquire);
+            if (item != NULL) {
+                return item;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Lossy ring dequeue. Consumers race for ring_head with a CAS,
+ *        jumping over positions a lap or more behind tail, whose items
+ *        have been overwritten. The claimed cell may still be empty while
+ *        its producer finishes the swap; the consumer waits for that, but
+ *        gives the position up once the cell's stored count shows every
+ *        producer up to its lap is done, because then the item was taken
+ *        by a consumer from an earlier lap or evicted. Items therefore
+ *        come out in roughly FIFO order and at most once. A producer that
+ *        swaps in after every position of its cell was passed strands its
+ *        item until the next lap evicts it; once shutdown leaves nothing
+ *        to claim, consumers pick such items up with lossy_stranded, and
+ *        queue_destroy evicts whatever is still left.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data (a void **).
+ * @param deadline When to stop waiting for an item (see NO_WAIT).
+ * @param pow2 Whether the capacity is a power of two (a constant).
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once the queue is shutdown and drained,
+ *         or if the ring stays empty QUEUE_EMPTY (NO_WAIT) or QUEUE_TIMEOUT.
+ */
+static ALWAYS_INLINE queue_status_t lossy_dequeue(queue_t q, void *out,
+                                                  const struct timespec *deadline, const bool pow2) {
+    size_t cap = (size_t)q->capacity;
+    for (;;) {
+        size_t head = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&q->ring_tail, memory_order_acquire);
+        if (head == tail) {
+            if (atomic_load(&q->shutdown)) {
+                void *item = lossy_stranded(q);
+                if (item == NULL) {
+                    return QUEUE_SHUTDOWN;
+                }
+                *(void **)out = item;
+                probe_ring("dequeue", q, 1);
+                return QUEUE_OK;
+            }
+            if (deadline == NO_WAIT) {
+                return QUEUE_EMPTY;
+            }
+            if (lossy_wait(q, head, deadline)) {
+                return QUEUE_TIMEOUT;
+            }
+            continue;
+        }
+        size_t pos = tail - head > cap ? tail - cap : head;
+        if (!atomic_compare_exchange_weak_explicit(&q->ring_head, &head, pos + 1,
+                                                   memory_order_relaxed, memory_order_relaxed)) {
+            continue;
+        }
+        struct lossy_cell *cell = &q->cells[ring_slot(q, pos, pow2)];
+        void *item = atomic_exchange_explicit(&cell->item, NULL, memory_order_acquire);
+        for (int spins = 0; item == NULL; spins++) {
+            // As many producers as laps 0 .. pos / cap have finished with the
+            // cell. stored does not say which laps they belonged to, so a
+            // slower earlier lap may still swap in later and strand its item
+            // (see lossy_stranded). The exchange hands each item out once.
+            if (atomic_load_explicit(&cell->stored, memory_order_acquire) > pos / cap) {
+                item = atomic_exchange_explicit(&cell->item, NULL, memory_order_acquire);
+                break;
+            }
+            if (spins < SPIN_FLOOR) {
+                cpu_relax();
+            } else {
+                sched_yield();
+            }
+            item = atomic_exchange_explicit(&cell->item, NULL, memory_order_acquire);
+        }
+        if (item != NULL) {
+            *(void **)out = item;
+            probe_ring("dequeue", q, 1);
+            return QUEUE_OK;
+        }
+    }
+}
+
+/**
+ * @brief Specializations of the lossy ring per-item paths.
+ */
+static queue_status_t lossy_enqueue_mask(queue_t q, void *data, const struct timespec *deadline) {
+    return lossy_enqueue(q, data, deadline, true);
+}
+
+static queue_status_t lossy_enqueue_mod(queue_t q, void *data, const struct timespec *deadline) {
+    return lossy_enqueue(q, data, deadline, false);
+}
+
+static queue_status_t lossy_dequeue_mask(queue_t q, void *out, const struct timespec *deadline) {
+    return lossy_dequeue(q, out, deadline, true);
+}
+
+static queue_status_t lossy_dequeue_mod(queue_t q, void *out, const struct timespec *deadline) {
+    return lossy_dequeue(q, out, deadline, false);
+}
+
+/**
+ * @brief Frees all resources associated with the queue.
+ *        Should signal all waiting threads so they can exit properly.
+ *
+ * @param q The queue to destroy.
+ */
+void queue_destroy(queue_t q) {
+    // Nothing to destroy if queue is NULL
+    if (q == NULL) {
+        return;
+    }
+    if (q->ops->compact) {
+        compact_shutdown((struct compact_queue *)q);
+        free(q);
+        return;
+    }
+    // Lock the mutex to safely update shared data.
+    queue_lock(q, LOCK_SHUTDOWN);
+    // Signal shutdown
+    signal_shutdown(q);
+    // Unlock the mutex after setting shutdown and signaling condition variables.
+    queue_unlock(q);
+#ifdef QUEUE_LOCK_PROFILE
+    queue_lock_profile_dump(q);
+#endif
+    // Items a lossy ring still holds were accepted but never dequeued, so
+    // they are lost the same way as the ones a lap pushed out.
+    if (q->cells != NULL) {
+        for (void *item; (item = lossy_stranded(q)) != NULL;) {
+            atomic_fetch_add_explicit(&q->evicted, 1, memory_order_relaxed);
+            if (q->evict != NULL) {
+                q->evict(item, q->evict_arg);
+            }
+        }
+    }
+    // Destroy the mutex and condition variables now that no threads should be waiting.
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    // Free the queue structure, which also holds the circular buffer
+    // unless it lives in a mapping of its own; in-place queues belong to
+    // the caller.
+    if (q->mapping != NULL) {
+        munmap(q->mapping, q->mapping_bytes);
+    }
+    unbounded_free(q);
+    stats_destroy(q);
+    if (!q->in_place) {
+        free(q);
+    }
+}
+
+/**
+ * @brief Byte-bounded mode bookkeeping for an item of n bytes entering
+ *        the queue, keeping the high-water mark. Called with q->lock held;
+ *        the counters are atomic only so queue_stats can read them.
+ */
+static void bytes_queued(queue_t q, size_t n) {
+    size_t now = atomic_load_explicit(&q->bytes, memory_order_relaxed) + n;
+    atomic_store_explicit(&q->bytes, now, memory_order_relaxed);
+    if (now > atomic_load_explicit(&q->peak_bytes, memory_order_relaxed)) {
+        atomic_store_explicit(&q->peak_bytes, now, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Byte-bounded mode bookkeeping for an item of n bytes leaving the
+ *        queue. Called with q->lock held.
+ */
+static void bytes_dequeued(queue_t q, size_t n) {
+    size_t now = atomic_load_explicit(&q->bytes, memory_order_relaxed) - n;
+    atomic_store_explicit(&q->bytes, now, memory_order_relaxed);
+}
+
+/**
+ * @brief Whether a mutex backend queue has no room for one more item:
+ *        every slot is taken or, with a byte budget, the item's bytes do
+ *        not fit. An empty queue always has room, so an item larger than
+ *        the whole budget cannot block forever. Called with q->lock held.
+ *
+ * @param q The queue.
+ * @param bytes Size of the item to add.
+ * @param bounded Whether the queue has a byte budget (a constant).
+ */
+static ALWAYS_INLINE bool mutex_full(queue_t q, size_t bytes, const bool bounded) {
+    if (q->count == q->capacity) {
+        return true;
+    }
+    if (!bounded || q->count == 0) {
+        return false;
+    }
+    size_t used = atomic_load_explicit(&q->bytes, memory_order_relaxed);
+    return used > q->max_bytes || bytes > q->max_bytes - used;
+}
+
+/**
+ * @brief QUEUE_OVERFLOW_EVICT for the mutex backend: drops the oldest
+ *        items, handing each to the eviction callback, until n slots are
+ *        free or, with a byte budget, until an item of the given size fits.
+ *        Called with q->lock held. Does nothing under the other policies,
+ *        after shutdown, or while a peeked span lends out the head.
+ *
+ * @param q The queue.
+ * @param n Number of slots the producer needs.
+ * @param bytes Size of the item to add, for byte-bounded queues.
+ * @param sized Whether the queue stores elements inline (a constant).
+ * @param bounded Whether the queue has a byte budget (a constant).
+ * @return Number of items evicted.
+ */
+static ALWAYS_INLINE int mutex_evict(queue_t q, int n, size_t bytes, const bool sized,
+                                     const bool bounded) {
+    if (q->overflow != QUEUE_OVERFLOW_EVICT || q->shutdown || q->peeked > 0) {
+        return 0;
+    }
+    int k = 0;
+    while (q->count > 0 && (bounded ? mutex_full(q, bytes, true) : k < n)) {
+        void *item = sized ? (void *)(q->elems + (size_t)q->head * q->elem_size) : q->buffer[q->head];
+        if (bounded) {
+            bytes_dequeued(q, q->sizes[q->head]);
+        }
+        if (q->counters != NULL) {
+            stats_dequeued(q, (size_t)q->head, 1);
+        }
+        if (q->evict != NULL) {
+            q->evict(item, q->evict_arg);
+        }
+        q->head = ring_advance(q, q->head, 1);
+        count_add(q, -1);
+        probe_count("dequeue", q, 1, q->count);
+        k++;
+    }
+    atomic_fetch_add_explicit(&q->evicted, (size_t)k, memory_order_relaxed);
+    return k;
+}
+
+/**
+ * @brief Mutex backend enqueue.
+ *        If the queue is full, this call applies the overflow policy, and
+ *        under QUEUE_OVERFLOW_BLOCK blocks until space is available or the
+ *        deadline passes. With NO_WAIT it rejects a full or shutdown
+ *        queue from an atomic pre-check without touching the lock, and
+ *        never waits for the lock.
+ *
+ * @param q The queue.
+ * @param data The data to add; for sized queues, the element to copy.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, NULL for none, or NO_WAIT.
+ * @param sized Whether the queue stores elements inline (a constant).
+ * @param bounded Whether the queue has a byte budget (a constant).
+ * @param bytes Size of the item, counted against the byte budget.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN or QUEUE_TIMEOUT; QUEUE_FULL with
+ *         NO_WAIT or QUEUE_OVERFLOW_REJECT; with NO_WAIT also QUEUE_BUSY if
+ *         the lock was held by another thread or a reservation is pending.
+ */
+static ALWAYS_INLINE queue_status_t mutex_enqueue(queue_t q, void *data,
+                                                  const struct timespec *deadline, const bool sized,
+                                                  const bool bounded, size_t bytes) {
+    if (deadline == NO_WAIT) {
+        // Answer from the atomic state alone whenever possible.
+        if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+            return QUEUE_SHUTDOWN;
+        }
+        if (atomic_load_explicit(&q->count, memory_order_relaxed) == q->capacity &&
+            q->overflow != QUEUE_OVERFLOW_EVICT) {
+            return overflow_reject(q, 1);
+        }
+        if (queue_trylock(q, LOCK_ENQUEUE) != 0) {
+            return QUEUE_BUSY;
+        }
+        // Re-check under the lock; the pre-check may be stale.
+        queue_status_t status = q->shutdown ? QUEUE_SHUTDOWN
+                              : mutex_full(q, bytes, bounded) &&
+                                mutex_evict(q, 1, bytes, sized, bounded) == 0 ? overflow_reject(q, 1)
+                              : q->reserved > 0 ? QUEUE_BUSY : QUEUE_OK;
+        if (status != QUEUE_OK) {
+            queue_unlock(q);
+            return status;
+        }
+    } else {
+        // Spin or yield first, per the wait strategy, if the queue looks full.
+        uint64_t waited = 0; // Stats mode: when this call started to wait
+        if (atomic_load_explicit(&q->count, memory_order_relaxed) == q->capacity) {
+            waited = spin_clock(q, true);
+            spin_wait(q, mutex_not_full, 1);
+        }
+        // Lock the mutex to safely access shared data.
+        queue_lock(q, LOCK_ENQUEUE);
+        // A full queue applies the overflow policy before anyone waits;
+        // REJECT also refuses rather than wait for a pending reservation.
+        if (q->overflow == QUEUE_OVERFLOW_REJECT && !q->shutdown &&
+            (mutex_full(q, bytes, bounded) || q->reserved > 0)) {
+            queue_unlock(q);
+            stats_waited(q, true, waited);
+            return overflow_reject(q, 1);
+        }
+        if (q->overflow == QUEUE_OVERFLOW_EVICT && !q->shutdown && mutex_full(q, bytes, bounded)) {
+            mutex_evict(q, 1, bytes, sized, bounded);
+        }
+        // Wait while the queue is full (or a reservation owns the tail) and
+        // shutdown has NOT been called.
+        while ( (mutex_full(q, bytes, bounded) || q->reserved > 0) && !q->shutdown ) {
+            if (waited == 0) {
+                waited = stats_clock(q, true);
+            }
+            // release the mutex while waiting, re-locks it after signaled.
+            if (park(q, &q->not_full, &q->producers, deadline) &&
+                (mutex_full(q, bytes, bounded) || q->reserved > 0) && !q->shutdown) {
+                queue_unlock(q);
+                stats_waited(q, true, waited);
+                return QUEUE_TIMEOUT;
+            }
+        }
+        stats_waited(q, true, waited);
+        // If shutdown was called while waiting, exit early.
+        if (q->shutdown) {
+            queue_unlock(q);
+            return QUEUE_SHUTDOWN;
+        }
+    }
+    // Add the data to the tail of the buffer; sized queues copy the element.
+    if (sized) {
+        memcpy(q->elems + (size_t)q->tail * q->elem_size, data, q->elem_size);
+    } else {
+        q->buffer[q->tail] = data;
+    }
+    if (bounded) {
+        q->sizes[q->tail] = bytes;
+        bytes_queued(q, bytes);
+    }
+    if (q->counters != NULL) {
+        stats_enqueued(q, (size_t)q->tail, 1, q->count + 1);
+    }
+    q->tail = ring_advance(q, q->tail, 1); // Wrap around (circular buffer).
+    count_add(q, 1); // Increase the count of items in the queue.
+    probe_count("enqueue", q, 1, q->count);
+    // Wake one sleeping consumer for the new item, if any is waiting.
+    unpark(q, &q->not_empty, &q->consumers, 1);
+    // Unlock the mutex when done modifying the queue.
+    queue_unlock(q);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Mutex backend dequeue.
+ *        If the queue is empty, this call blocks until an item is available
+ *        or the deadline passes. With NO_WAIT it detects an empty queue
+ *        from an atomic pre-check without touching the lock, and never
+ *        waits for the lock.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data on QUEUE_OK (a void **); for
+ *            sized queues, where to copy the element.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, NULL for none, or NO_WAIT.
+ * @param sized Whether the queue stores elements inline (a constant).
+ * @param lazy Whether the ring returns its pages when drained (a constant).
+ * @param bounded Whether the queue has a byte budget (a constant).
+ * @param bytes Where to store the size of the item on QUEUE_OK, or NULL.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once shutdown and drained, or
+ *         QUEUE_TIMEOUT; with NO_WAIT also QUEUE_EMPTY, or QUEUE_BUSY if the
+ *         lock was held by another thread or a peeked span is pending.
+ */
+static ALWAYS_INLINE queue_status_t mutex_dequeue(queue_t q, void *out,
+                                                  const struct timespec *deadline,
+                                                  const bool sized, const bool lazy,
+                                                  const bool bounded, size_t *bytes) {
+    if (deadline == NO_WAIT) {
+        // Answer from the atomic state alone whenever possible.
+        if (atomic_load_explicit(&q->count, memory_order_relaxed) == 0) {
+            return atomic_load(&q->shutdown) ? QUEUE_SHUTDOWN : QUEUE_EMPTY;
+        }
+        if (queue_trylock(q, LOCK_DEQUEUE) != 0) {
+            return QUEUE_BUSY;
+        }
+        // Re-check under the lock; the pre-check may be stale.
+        queue_status_t status = q->count == 0 ? (q->shutdown ? QUEUE_SHUTDOWN : QUEUE_EMPTY)
+                              : q->peeked > 0 ? QUEUE_BUSY : QUEUE_OK;
+        if (status != QUEUE_OK) {
+            queue_unlock(q);
+            return status;
+        }
+    } else {
+        // Spin or yield first, per the wait strategy, if the queue looks empty.
+        uint64_t waited = 0; // Stats mode: when this call started to wait
+        if (atomic_load_explicit(&q->count, memory_order_relaxed) == 0) {
+            waited = spin_clock(q, false);
+            spin_wait(q, mutex_not_empty, 1);
+        }
+        // Lock the mutex to safely access shared data.
+        queue_lock(q, LOCK_DEQUEUE);
+        // Wait while the queue is empty and shutdown has NOT been called, and
+        // while a peeked span still lends out the head (even after shutdown).
+        while ( ((q->count == 0) && !q->shutdown) || q->peeked > 0 ) {
+            if (waited == 0) {
+                waited = stats_clock(q, false);
+            }
+            // release the mutex while waiting, re-locks it after signaled.
+            if (park(q, &q->not_empty, &q->consumers, deadline) &&
+                (((q->count == 0) && !q->shutdown) || q->peeked > 0)) {
+                queue_unlock(q);
+                stats_waited(q, false, waited);
+                return QUEUE_TIMEOUT;
+            }
+        }
+        stats_waited(q, false, waited);
+        // If shutdown was called and the queue is empty, exit.
+        if ( q->shutdown && (q->count == 0) ) {
+            queue_unlock(q);
+            return QUEUE_SHUTDOWN;
+        }
+    }
+    // Remove the item from the head of the buffer; sized queues copy it out.
+    if (sized) {
+        memcpy(out, q->elems + (size_t)q->head * q->elem_size, q->elem_size);
+    } else {
+        *(void **)out = q->buffer[q->head];
+    }
+    if (bounded) {
+        size_t freed = q->sizes[q->head];
+        bytes_dequeued(q, freed);
+        if (bytes != NULL) {
+            *bytes = freed;
+        }
+    }
+    if (q->counters != NULL) {
+        stats_dequeued(q, (size_t)q->head, 1);
+    }
+    q->head = ring_advance(q, q->head, 1); // Wrap around (circular buffer).
+    count_add(q, -1); // Decrease the count of items in the queue.
+    probe_count("dequeue", q, 1, q->count);
+    if (lazy) {
+        lazy_dequeued(q, 1);
+    }
+    // Wake one sleeping producer for the freed slot, if any is waiting.
+    // Freed bytes may let any of them fit, whatever their item sizes, so
+    // byte-bounded queues wake them all.
+    unpark(q, &q->not_full, &q->producers, bounded ? INT_MAX : 1);
+    // Unlock the mutex when done modifying the queue.
+    queue_unlock(q);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Specializations of the mutex per-item paths for pointer (_ptr) and
+ *        inline element (_elem) queues, with and without a lazy ring.
+ */
+static queue_status_t mutex_enqueue_ptr(queue_t q, void *data, const struct timespec *deadline) {
+    return mutex_enqueue(q, data, deadline, false, false, 0);
+}
+
+static queue_status_t mutex_enqueue_elem(queue_t q, void *elem, const struct timespec *deadline) {
+    return mutex_enqueue(q, elem, deadline, true, false, 0);
+}
+
+static queue_status_t mutex_dequeue_ptr(queue_t q, void *out, const struct timespec *deadline) {
+    return mutex_dequeue(q, out, deadline, false, false, false, NULL);
+}
+
+static queue_status_t mutex_dequeue_ptr_lazy(queue_t q, void *out, const struct timespec *deadline) {
+    return mutex_dequeue(q, out, deadline, false, true, false, NULL);
+}
+
+static queue_status_t mutex_dequeue_elem(queue_t q, void *out, const struct timespec *deadline) {
+    return mutex_dequeue(q, out, deadline, true, false, false, NULL);
+}
+
+static queue_status_t mutex_dequeue_elem_lazy(queue_t q, void *out, const struct timespec *deadline) {
+    return mutex_dequeue(q, out, deadline, true, true, false, NULL);
+}
+
+/**
+ * @brief Byte-bounded pointer queues: the plain calls count items as 0
+ *        bytes. Rare enough that lazy is tested at run time.
+ */
+static queue_status_t mutex_enqueue_bounded(queue_t q, void *data, const struct timespec *deadline) {
+    return mutex_enqueue(q, data, deadline, false, true, 0);
+}
+
+static queue_status_t mutex_dequeue_bounded(queue_t q, void *out, const struct timespec *deadline) {
+    return mutex_dequeue(q, out, deadline, false, q->lazy, true, NULL);
+}
+
+/**
+ * @brief Mutex backend batch enqueue.
+ *        Every critical section moves as many items as currently fit, copies
+ *        them with at most two memcpy calls and wakes at most one sleeping
+ *        consumer per item.
+ *        Blocks while the queue is full until all n items are enqueued,
+ *        unless the overflow policy evicts old items or rejects the rest.
+ *
+ * @param q The queue.
+ * @param items The items to add, none of which may be NULL.
+ * @param n Number of items.
+ * @return Number of items enqueued; fewer than n only after shutdown or
+ *         when QUEUE_OVERFLOW_REJECT refused the rest.
+ */
+static int mutex_enqueue_batch(queue_t q, void **items, int n) {
+    int done = 0;
+    uint64_t waited = 0;
+    if (atomic_load_explicit(&q->count, memory_order_relaxed) == q->capacity) {
+        waited = spin_clock(q, true);
+        spin_wait(q, mutex_not_full, 1);
+    }
+    queue_lock(q, LOCK_ENQUEUE);
+    while (done < n) {
+        if (q->overflow == QUEUE_OVERFLOW_REJECT && !q->shutdown &&
+            (q->count == q->capacity || q->reserved > 0)) {
+            overflow_reject(q, n - done);
+            break;
+        }
+        if (q->overflow == QUEUE_OVERFLOW_EVICT && q->count == q->capacity && !q->shutdown) {
+            mutex_evict(q, n - done, 0, false, false);
+        }
+        // Wait while the queue is full (or reserved) and shutdown has NOT been called.
+        while ( (q->count == q->capacity || q->reserved > 0) && !q->shutdown ) {
+            if (waited == 0) {
+                waited = stats_clock(q, true);
+            }
+            park(q, &q->not_full, &q->producers, NULL);
+        }
+        stats_waited(q, true, waited);
+        waited = 0;
+        if (q->shutdown) {
+            break;
+        }
+        // Move everything that fits in one go.
+        int k = q->capacity - q->count;
+        if (k > n - done) {
+            k = n - done;
+        }
+        ring_copy_in(q->buffer, ring_run(q), (size_t)q->tail, items + done, (size_t)k);
+        if (q->counters != NULL) {
+            stats_enqueued(q, (size_t)q->tail, (size_t)k, q->count + k);
+        }
+        q->tail = ring_advance(q, q->tail, k);
+        count_add(q, k);
+        probe_count("enqueue", q, k, q->count);
+        done += k;
+        // Wake as many sleeping consumers as there are new items.
+        unpark(q, &q->not_empty, &q->consumers, k);
+    }
+    stats_waited(q, true, waited); // Only set if the overflow policy cut the wait short
+    queue_unlock(q);
+    return done;
+}
+
+/**
+ * @brief Mutex backend batch dequeue.
+ *        Blocks until at least min items are available (or shutdown), then
+ *        takes as many as possible, up to max, in a single critical section.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued items.
+ * @param max Maximum number of items to take.
+ * @param min Number of items to wait for, already clamped to [0, max].
+ * @return Number of items dequeued; 0 once the queue is shutdown and drained.
+ */
+static int mutex_dequeue_batch(queue_t q, void **out, int max, int min) {
+    uint64_t waited = 0;
+    if (atomic_load_explicit(&q->count, memory_order_relaxed) < min) {
+        waited = spin_clock(q, false);
+        spin_wait(q, mutex_not_empty, (size_t)min);
+    }
+    queue_lock(q, LOCK_DEQUEUE);
+    // Wait until enough items are available and shutdown has NOT been called,
+    // and until no peeked span lends out the head.
+    while ( ((q->count < min) && !q->shutdown) || q->peeked > 0 ) {
+        if (waited == 0) {
+            waited = stats_clock(q, false);
+        }
+        park(q, &q->not_empty, &q->consumers, NULL);
+    }
+    stats_waited(q, false, waited);
+    int done = q->count < max ? q->count : max;
+    if (done > 0) {
+        ring_copy_out(q->buffer, ring_run(q), (size_t)q->head, out, (size_t)done);
+        if (q->counters != NULL) {
+            stats_dequeued(q, (size_t)q->head, (size_t)done);
+        }
+        q->head = ring_advance(q, q->head, done);
+        count_add(q, -done);
+        probe_count("dequeue", q, done, q->count);
+        // Once per batch, so not worth a specialization of its own.
+        if (q->lazy) {
+            lazy_dequeued(q, done);
+        }
+        // Wake as many sleeping producers as there are freed slots.
+        unpark(q, &q->not_full, &q->producers, done);
+    }
+    queue_unlock(q);
+    return done;
+}
+
+/**
+ * @brief Ops table entries for calls a queue does not support: pointer
+ *        calls on a sized queue and the other way round. They report
+ *        QUEUE_SHUTDOWN, or 0 items for the batch calls.
+ */
+static queue_status_t reject_item(queue_t q, void *item, const struct timespec *deadline) {
+    (void)q;
+    (void)item;
+    (void)deadline;
+    return QUEUE_SHUTDOWN;
+}
+
+static int reject_enqueue_batch(queue_t q, void **items, int n) {
+    (void)q;
+    (void)items;
+    (void)n;
+    return 0;
+}
+
+static int reject_dequeue_batch(queue_t q, void **out, int max, int min) {
+    (void)q;
+    (void)out;
+    (void)max;
+    (void)min;
+    return 0;
+}
+
+/**
+ * @brief Span entries for queues that lend out no slots: the MPMC and
+ *        lossy rings, byte-bounded, unbounded and compact queues.
+ */
+static queue_status_t reject_span(queue_t q, int n, queue_span_t *span) {
+    (void)q;
+    (void)n;
+    (void)span;
+    return QUEUE_SHUTDOWN;
+}
+
+static queue_status_t reject_commit(queue_t q, int n) {
+    (void)q;
+    (void)n;
+    return QUEUE_SHUTDOWN;
+}
+
+static void reject_release(queue_t q, int n) {
+    (void)q;
+    (void)n;
+}
+
+static void compact_unlock(void *q) {
+    word_unlock(&((struct compact_queue *)q)->lock);
+}
+
+/**
+ * @brief Parks the calling thread on the address of a waiter count of the
+ *        compact queue, dropping the queue lock once it is queued in the
+ *        parking lot and taking it back after waking. A waker holding the
+ *        lock therefore always finds every thread it counts.
+ *
+ * @param q The compact queue, locked by the caller.
+ * @param waiters &q->producers or &q->consumers.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return True if the deadline passed.
+ */
+static bool compact_park(struct compact_queue *q, int *waiters, const struct timespec *deadline) {
+    (*waiters)++;
+    probe_blocked(q, waiters == &q->producers);
+    bool timed_out = lot_park(waiters, NULL, compact_unlock, q, deadline);
+    word_lock(&q->lock);
+    probe_woken(q, waiters == &q->producers, timed_out);
+    (*waiters)--;
+    return timed_out;
+}
+
+/**
+ * @brief Unparks up to n threads parked on a waiter count of the compact
+ *        queue. Counted threads that already woke are not in the lot, so
+ *        the loop stops at the first miss.
+ */
+static void compact_unpark(int *waiters, int n) {
+    for (int i = 0; i < n; i++) {
+        if (!lot_unpark_one(waiters, NULL, NULL)) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Compact enqueue: the mutex backend's enqueue over a word lock.
+ *
+ * @param q The queue, a struct compact_queue.
+ * @param data The data to add.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, NULL for none, or NO_WAIT.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN or QUEUE_TIMEOUT; with NO_WAIT also
+ *         QUEUE_FULL, or QUEUE_BUSY if the lock was held.
+ */
+static queue_status_t compact_enqueue(queue_t q, void *data, const struct timespec *deadline) {
+    struct compact_queue *cq = (struct compact_queue *)q;
+    if (deadline == NO_WAIT) {
+        if (atomic_load_explicit(&cq->shutdown, memory_order_relaxed)) {
+            return QUEUE_SHUTDOWN;
+        }
+        if (!word_trylock(&cq->lock)) {
+            return QUEUE_BUSY;
+        }
+        if (cq->shutdown || cq->count == cq->capacity) {
+            queue_status_t status = cq->shutdown ? QUEUE_SHUTDOWN : QUEUE_FULL;
+            word_unlock(&cq->lock);
+            return status;
+        }
+    } else {
+        word_lock(&cq->lock);
+        while (cq->count == cq->capacity && !cq->shutdown) {
+            if (compact_park(cq, &cq->producers, deadline) &&
+                cq->count == cq->capacity && !cq->shutdown) {
+                word_unlock(&cq->lock);
+                return QUEUE_TIMEOUT;
+            }
+        }
+        if (cq->shutdown) {
+            word_unlock(&cq->lock);
+            return QUEUE_SHUTDOWN;
+        }
+    }
+    unsigned tail = (unsigned)cq->head + (unsigned)cq->count;
+    cq->slots[tail >= (unsigned)cq->capacity ? tail - (unsigned)cq->capacity : tail] = data;
+    cq->count++;
+    probe_count("enqueue", cq, 1, cq->count);
+    bool wake = cq->consumers > 0;
+    word_unlock(&cq->lock);
+    // The parked consumer is already in the lot, so waking after the
+    // unlock cannot miss it and spares it a trip through the lock word.
+    if (wake) {
+        compact_unpark(&cq->consumers, 1);
+    }
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Compact dequeue: the mutex backend's dequeue over a word lock.
+ *
+ * @param q The queue, a struct compact_queue.
+ * @param out Where to store the dequeued data (a void **).
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, NULL for none, or NO_WAIT.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once shutdown and drained, or
+ *         QUEUE_TIMEOUT; with NO_WAIT also QUEUE_EMPTY, or QUEUE_BUSY if
+ *         the lock was held.
+ */
+static queue_status_t compact_dequeue(queue_t q, void *out, const struct timespec *deadline) {
+    struct compact_queue *cq = (struct compact_queue *)q;
+    if (deadline == NO_WAIT) {
+        if (!word_trylock(&cq->lock)) {
+            return QUEUE_BUSY;
+        }
+        if (cq->count == 0) {
+            queue_status_t status = cq->shutdown ? QUEUE_SHUTDOWN : QUEUE_EMPTY;
+            word_unlock(&cq->lock);
+            return status;
+        }
+    } else {
+        word_lock(&cq->lock);
+        while (cq->count == 0 && !cq->shutdown) {
+            if (compact_park(cq, &cq->consumers, deadline) && cq->count == 0 && !cq->shutdown) {
+                word_unlock(&cq->lock);
+                return QUEUE_TIMEOUT;
+            }
+        }
+        if (cq->count == 0) {
+            word_unlock(&cq->lock);
+            return QUEUE_SHUTDOWN;
+        }
+    }
+    *(void **)out = cq->slots[cq->head];
+    cq->head = cq->head + 1 == cq->capacity ? 0 : cq->head + 1;
+    cq->count--;
+    probe_count("dequeue", cq, 1, cq->count);
+    bool wake = cq->producers > 0;
+    word_unlock(&cq->lock);
+    if (wake) {
+        compact_unpark(&cq->producers, 1);
+    }
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Compact batch enqueue: moves as many items as fit per lock hold.
+ */
+static int compact_enqueue_batch(queue_t q, void **items, int n) {
+    struct compact_queue *cq = (struct compact_queue *)q;
+    int done = 0;
+    word_lock(&cq->lock);
+    while (done < n) {
+        while (cq->count == cq->capacity && !cq->shutdown) {
+            compact_park(cq, &cq->producers, NULL);
+        }
+        if (cq->shutdown) {
+            break;
+        }
+        int k = cq->capacity - cq->count;
+        if (k > n - done) {
+            k = n - done;
+        }
+        unsigned tail = (unsigned)cq->head + (unsigned)cq->count;
+        if (tail >= (unsigned)cq->capacity) {
+            tail -= (unsigned)cq->capacity;
+        }
+        ring_copy_in(cq->slots, (size_t)cq->capacity, tail, items + done, (size_t)k);
+        cq->count += k;
+        probe_count("enqueue", cq, k, cq->count);
+        done += k;
+        compact_unpark(&cq->consumers, k < cq->consumers ? k : cq->consumers);
+    }
+    word_unlock(&cq->lock);
+    return done;
+}
+
+/**
+ * @brief Compact batch dequeue: waits for min items, then takes up to max.
+ */
+static int compact_dequeue_batch(queue_t q, void **out, int max, int min) {
+    struct compact_queue *cq = (struct compact_queue *)q;
+    word_lock(&cq->lock);
+    while (cq->count < min && !cq->shutdown) {
+        compact_park(cq, &cq->consumers, NULL);
+    }
+    int done = cq->count < max ? cq->count : max;
+    if (done > 0) {
+        ring_copy_out(cq->slots, (size_t)cq->capacity, (size_t)cq->head, out, (size_t)done);
+        unsigned head = (unsigned)cq->head + (unsigned)done;
+        cq->head = (int)(head >= (unsigned)cq->capacity ? head - (unsigned)cq->capacity : head);
+        cq->count -= done;
+        probe_count("dequeue", cq, done, cq->count);
+    }
+    int wake = done < cq->producers ? done : cq->producers;
+    word_unlock(&cq->lock);
+    compact_unpark(&cq->producers, wake);
+    return done;
+}
+
+/**
+ * @brief Shuts a compact queue down and wakes every parked producer and
+ *        consumer; threads waiting for the lock get it in turn.
+ */
+static void compact_shutdown(struct compact_queue *cq) {
+    QUEUE_PROBE1("shutdown", PROBE_VAL(cq));
+    word_lock(&cq->lock);
+    cq->shutdown = true;
+    word_unlock(&cq->lock);
+    lot_unpark_all(&cq->producers);
+    lot_unpark_all(&cq->consumers);
+}
+
+static const struct queue_ops compact_ops = {
+    .enqueue = compact_enqueue,
+    .dequeue = compact_dequeue,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = compact_enqueue_batch,
+    .dequeue_batch = compact_dequeue_batch,
+    .reserve = reject_span,
+    .commit = reject_commit,
+    .peek_span = reject_span,
+    .release = reject_release,
+    .is_empty = compact_is_empty,
+    .stats = compact_stats,
+    .compact = true,
+};
+
+/**
+ * @brief Allocates a compact queue: the header above and the slots, with
+ *        no cache-line padding, since footprint is the point.
+ *
+ * @param capacity The maximum number of items the queue can hold.
+ * @return The queue, or NULL on failure.
+ */
+static queue_t compact_create(int capacity) {
+    if ((size_t)capacity > (SIZE_MAX - sizeof(struct compact_queue)) / sizeof(void *)) {
+        return NULL;
+    }
+    struct compact_queue *cq = malloc(sizeof(*cq) + (size_t)capacity * sizeof(void *));
+    if (cq == NULL) {
+        return NULL;
+    }
+    cq->ops = &compact_ops;
+    atomic_init(&cq->lock, 0);
+    cq->capacity = capacity;
+    cq->head = 0;
+    cq->count = 0;
+    cq->producers = 0;
+    cq->consumers = 0;
+    atomic_init(&cq->shutdown, false);
+    return (queue_t)cq;
+}
+
+/**
+ * @brief Takes a segment for the unbounded backend from the free list, or
+ *        allocates one. Called with q->lock held.
+ *
+ * @param q The queue.
+ * @return The segment, with no successor, or NULL if out of memory.
+ */
+static struct segment *segment_get(queue_t q) {
+    struct segment *seg = q->seg_free;
+    if (seg != NULL) {
+        q->seg_free = seg->next;
+        q->seg_cached--;
+    } else {
+        seg = malloc(sizeof(*seg));
+        if (seg == NULL) {
+            return NULL;
+        }
+        atomic_store_explicit(&q->segments, atomic_load_explicit(&q->segments, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+    }
+    seg->next = NULL;
+    return seg;
+}
+
+/**
+ * @brief Hands a drained segment back: onto the free list while it holds
+ *        fewer than seg_cache segments, otherwise to free(). Called with
+ *        q->lock held.
+ *
+ * @param q The queue.
+ * @param seg The segment, no longer linked into the queue.
+ */
+static void segment_put(queue_t q, struct segment *seg) {
+    if (q->seg_cached < q->seg_cache) {
+        seg->next = q->seg_free;
+        q->seg_free = seg;
+        q->seg_cached++;
+        return;
+    }
+    free(seg);
+    atomic_store_explicit(&q->segments, atomic_load_explicit(&q->segments, memory_order_relaxed) - 1,
+                          memory_order_relaxed);
+}
+
+/**
+ * @brief Appends up to n items to an unbounded queue, linking in a new
+ *        segment whenever the tail one is full. Called with q->lock held.
+ *
+ * @param q The queue.
+ * @param items The items to add.
+ * @param n Number of items.
+ * @return Number of items added; fewer than n only if out of memory or
+ *         the count would pass INT_MAX.
+ */
+static ALWAYS_INLINE int unbounded_push(queue_t q, void *const *items, int n) {
+    if (n > INT_MAX - q->count) {
+        n = INT_MAX - q->count;
+    }
+    int done = 0;
+    while (done < n) {
+        if (q->tail == SEGMENT_ITEMS) {
+            struct segment *seg = segment_get(q);
+            if (seg == NULL) {
+                break;
+            }
+            if (q->seg_tail != NULL) {
+                q->seg_tail->next = seg;
+            } else {
+                q->seg_head = seg;
+            }
+            q->seg_tail = seg;
+            q->tail = 0;
+        }
+        int k = SEGMENT_ITEMS - q->tail < n - done ? SEGMENT_ITEMS - q->tail : n - done;
+        memcpy(q->seg_tail->items + q->tail, items + done, (size_t)k * sizeof(void *));
+        q->tail += k;
+        done += k;
+    }
+    return done;
+}
+
+/**
+ * @brief Removes n items from the head of an unbounded queue, which holds
+ *        at least n, retiring every segment it drains. Called with
+ *        q->lock held.
+ *
+ * @param q The queue.
+ * @param out Where to store the items.
+ * @param n Number of items.
+ */
+static ALWAYS_INLINE void unbounded_pop(queue_t q, void **out, int n) {
+    int done = 0;
+    while (done < n) {
+        int k = SEGMENT_ITEMS - q->head < n - done ? SEGMENT_ITEMS - q->head : n - done;
+        memcpy(out + done, q->seg_head->items + q->head, (size_t)k * sizeof(void *));
+        q->head += k;
+        done += k;
+        if (q->head == SEGMENT_ITEMS) {
+            // Drained; if it was also the tail segment, its tail is at the
+            // end too, so the next enqueue links in a fresh one.
+            struct segment *seg = q->seg_head;
+            q->seg_head = seg->next;
+            if (q->seg_head == NULL) {
+                q->seg_tail = NULL;
+            }
+            q->head = 0;
+            segment_put(q, seg);
+        }
+    }
+}
+
+/**
+ * @brief Unbounded enqueue. Never waits for space: a full tail segment
+ *        gets a successor from the free list or malloc. With NO_WAIT it
+ *        does not wait for the lock either.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @param deadline NO_WAIT to give up on a held lock; otherwise unused.
+ * @return QUEUE_OK or QUEUE_SHUTDOWN; QUEUE_FULL if out of memory or
+ *         INT_MAX items are queued, or with NO_WAIT QUEUE_BUSY if the lock
+ *         was held.
+ */
+static queue_status_t unbounded_enqueue(queue_t q, void *data, const struct timespec *deadline) {
+    if (deadline == NO_WAIT) {
+        if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+            return QUEUE_SHUTDOWN;
+        }
+        if (queue_trylock(q, LOCK_ENQUEUE) != 0) {
+            return QUEUE_BUSY;
+        }
+    } else {
+        queue_lock(q, LOCK_ENQUEUE);
+    }
+    queue_status_t status = q->shutdown ? QUEUE_SHUTDOWN
+                          : unbounded_push(q, &data, 1) == 1 ? QUEUE_OK : QUEUE_FULL;
+    if (status == QUEUE_OK) {
+        count_add(q, 1);
+        probe_count("enqueue", q, 1, q->count);
+        unpark(q, &q->not_empty, &q->consumers, 1);
+    }
+    queue_unlock(q);
+    return status;
+}
+
+/**
+ * @brief Unbounded dequeue: the mutex backend's dequeue over segments.
+ *        Blocks while the queue is empty, until the deadline or shutdown.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data (a void **).
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, NULL for none, or NO_WAIT.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once shutdown and drained, or
+ *         QUEUE_TIMEOUT; with NO_WAIT also QUEUE_EMPTY, or QUEUE_BUSY if
+ *         the lock was held.
+ */
+static queue_status_t unbounded_dequeue(queue_t q, void *out, const struct timespec *deadline) {
+    if (deadline == NO_WAIT) {
+        if (atomic_load_explicit(&q->count, memory_order_relaxed) == 0) {
+            return atomic_load(&q->shutdown) ? QUEUE_SHUTDOWN : QUEUE_EMPTY;
+        }
+        if (queue_trylock(q, LOCK_DEQUEUE) != 0) {
+            return QUEUE_BUSY;
+        }
+    } else {
+        if (atomic_load_explicit(&q->count, memory_order_relaxed) == 0) {
+            spin_wait(q, mutex_not_empty, 1);
+        }
+        queue_lock(q, LOCK_DEQUEUE);
+        while (q->count == 0 && !q->shutdown) {
+            if (park(q, &q->not_empty, &q->consumers, deadline) && q->count == 0 && !q->shutdown) {
+                queue_unlock(q);
+                return QUEUE_TIMEOUT;
+            }
+        }
+    }
+    if (q->count == 0) {
+        queue_status_t status = q->shutdown ? QUEUE_SHUTDOWN : QUEUE_EMPTY;
+        queue_unlock(q);
+        return status;
+    }
+    unbounded_pop(q, out, 1);
+    count_add(q, -1);
+    probe_count("dequeue", q, 1, q->count);
+    queue_unlock(q);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Unbounded batch enqueue: all n items in one critical section.
+ *
+ * @return Number of items enqueued; fewer than n only after shutdown, if
+ *         out of memory, or once INT_MAX items are queued.
+ */
+static int unbounded_enqueue_batch(queue_t q, void **items, int n) {
+    queue_lock(q, LOCK_ENQUEUE);
+    int done = q->shutdown ? 0 : unbounded_push(q, items, n);
+    if (done > 0) {
+        count_add(q, done);
+        probe_count("enqueue", q, done, q->count);
+        unpark(q, &q->not_empty, &q->consumers, done);
+    }
+    queue_unlock(q);
+    return done;
+}
+
+/**
+ * @brief Unbounded batch dequeue: waits for min items (or shutdown), then
+ *        takes up to max in one critical section.
+ *
+ * @return Number of items dequeued; 0 once the queue is shutdown and drained.
+ */
+static int unbounded_dequeue_batch(queue_t q, void **out, int max, int min) {
+    if (atomic_load_explicit(&q->count, memory_order_relaxed) < min) {
+        spin_wait(q, mutex_not_empty, (size_t)min);
+    }
+    queue_lock(q, LOCK_DEQUEUE);
+    while (q->count < min && !q->shutdown) {
+        park(q, &q->not_empty, &q->consumers, NULL);
+    }
+    int done = q->count < max ? q->count : max;
+    if (done > 0) {
+        unbounded_pop(q, out, done);
+        count_add(q, -done);
+        probe_count("dequeue", q, done, q->count);
+    }
+    queue_unlock(q);
+    return done;
+}
+
+/**
+ * @brief Frees every segment of an unbounded queue, queued items and
+ *        cached segments alike. Items still queued are dropped.
+ *
+ * @param q The queue, which no other thread uses any more.
+ */
+static void unbounded_free(queue_t q) {
+    struct segment *lists[] = {q->seg_head, q->seg_free};
+    for (int i = 0; i < 2; i++) {
+        while (lists[i] != NULL) {
+            struct segment *next = lists[i]->next;
+            free(lists[i]);
+            lists[i] = next;
+        }
+    }
+    q->seg_head = q->seg_tail = q->seg_free = NULL;
+    q->seg_cached = 0;
+    atomic_store_explicit(&q->segments, 0, memory_order_relaxed);
+}
+
+static const struct queue_ops mutex_ops = {
+    .enqueue = mutex_enqueue_ptr,
+    .dequeue = mutex_dequeue_ptr,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = mutex_enqueue_batch,
+    .dequeue_batch = mutex_dequeue_batch,
+    .reserve = mutex_reserve,
+    .commit = mutex_commit,
+    .peek_span = mutex_peek_span,
+    .release = mutex_release,
+    .is_empty = mutex_is_empty,
+    .stats = mutex_stats,
+};
+
+static const struct queue_ops mutex_lazy_ops = {
+    .enqueue = mutex_enqueue_ptr,
+    .dequeue = mutex_dequeue_ptr_lazy,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = mutex_enqueue_batch,
+    .dequeue_batch = mutex_dequeue_batch,
+    .reserve = mutex_reserve,
+    .commit = mutex_commit,
+    .peek_span = mutex_peek_span,
+    .release = mutex_release,
+    .is_empty = mutex_is_empty,
+    .stats = mutex_stats,
+};
+
+static const struct queue_ops sized_ops = {
+    .enqueue = reject_item,
+    .dequeue = reject_item,
+    .enqueue_copy = mutex_enqueue_elem,
+    .dequeue_copy = mutex_dequeue_elem,
+    .enqueue_batch = reject_enqueue_batch,
+    .dequeue_batch = reject_dequeue_batch,
+    .reserve = mutex_reserve,
+    .commit = mutex_commit,
+    .peek_span = mutex_peek_span,
+    .release = mutex_release,
+    .is_empty = mutex_is_empty,
+    .stats = sized_stats,
+};
+
+static const struct queue_ops sized_lazy_ops = {
+    .enqueue = reject_item,
+    .dequeue = reject_item,
+    .enqueue_copy = mutex_enqueue_elem,
+    .dequeue_copy = mutex_dequeue_elem_lazy,
+    .enqueue_batch = reject_enqueue_batch,
+    .dequeue_batch = reject_dequeue_batch,
+    .reserve = mutex_reserve,
+    .commit = mutex_commit,
+    .peek_span = mutex_peek_span,
+    .release = mutex_release,
+    .is_empty = mutex_is_empty,
+    .stats = sized_stats,
+};
+
+static const struct queue_ops spsc_mask_ops = {
+    .enqueue = spsc_enqueue_mask,
+    .dequeue = spsc_dequeue_mask,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = spsc_enqueue_batch,
+    .dequeue_batch = spsc_dequeue_batch,
+    .reserve = spsc_reserve,
+    .commit = spsc_commit,
+    .peek_span = spsc_peek_span,
+    .release = spsc_release,
+    .is_empty = ring_is_empty,
+    .stats = spsc_stats,
+};
+
+static const struct queue_ops spsc_mod_ops = {
+    .enqueue = spsc_enqueue_mod,
+    .dequeue = spsc_dequeue_mod,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = spsc_enqueue_batch,
+    .dequeue_batch = spsc_dequeue_batch,
+    .reserve = spsc_reserve,
+    .commit = spsc_commit,
+    .peek_span = spsc_peek_span,
+    .release = spsc_release,
+    .is_empty = ring_is_empty,
+    .stats = spsc_stats,
+};
+
+static const struct queue_ops mpmc_mask_ops = {
+    .enqueue = mpmc_enqueue_mask,
+    .dequeue = mpmc_dequeue_mask,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = per_item_enqueue_batch,
+    .dequeue_batch = per_item_dequeue_batch,
+    .reserve = reject_span,
+    .commit = reject_commit,
+    .peek_span = reject_span,
+    .release = reject_release,
+    .is_empty = ring_is_empty,
+    .stats = mpmc_stats,
+};
+
+static const struct queue_ops mpmc_mod_ops = {
+    .enqueue = mpmc_enqueue_mod,
+    .dequeue = mpmc_dequeue_mod,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = per_item_enqueue_batch,
+    .dequeue_batch = per_item_dequeue_batch,
+    .reserve = reject_span,
+    .commit = reject_commit,
+    .peek_span = reject_span,
+    .release = reject_release,
+    .is_empty = ring_is_empty,
+    .stats = mpmc_stats,
+};
+
+static const struct queue_ops bytes_ops = {
+    .enqueue = mutex_enqueue_bounded,
+    .dequeue = mutex_dequeue_bounded,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = per_item_enqueue_batch,
+    .dequeue_batch = per_item_dequeue_batch,
+    .reserve = reject_span,
+    .commit = reject_commit,
+    .peek_span = reject_span,
+    .release = reject_release,
+    .is_empty = mutex_is_empty,
+    .stats = mutex_stats,
+};
+
+static const struct queue_ops lossy_mask_ops = {
+    .enqueue = lossy_enqueue_mask,
+    .dequeue = lossy_dequeue_mask,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = per_item_enqueue_batch,
+    .dequeue_batch = per_item_dequeue_batch,
+    .reserve = reject_span,
+    .commit = reject_commit,
+    .peek_span = reject_span,
+    .release = reject_release,
+    .is_empty = ring_is_empty,
+    .stats = lossy_stats,
+};
+
+static const struct queue_ops lossy_mod_ops = {
+    .enqueue = lossy_enqueue_mod,
+    .dequeue = lossy_dequeue_mod,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = per_item_enqueue_batch,
+    .dequeue_batch = per_item_dequeue_batch,
+    .reserve = reject_span,
+    .commit = reject_commit,
+    .peek_span = reject_span,
+    .release = reject_release,
+    .is_empty = ring_is_empty,
+    .stats = lossy_stats,
+};
+
+static const struct queue_ops unbounded_ops = {
+    .enqueue = unbounded_enqueue,
+    .dequeue = unbounded_dequeue,
+    .enqueue_copy = reject_item,
+    .dequeue_copy = reject_item,
+    .enqueue_batch = unbounded_enqueue_batch,
+    .dequeue_batch = unbounded_dequeue_batch,
+    .reserve = reject_span,
+    .commit = reject_commit,
+    .peek_span = reject_span,
+    .release = reject_release,
+    .is_empty = mutex_is_empty,
+    .stats = unbounded_stats,
+};
+
+/**
+ * @brief Picks the ops table matching a freshly created queue's options.
+ *
+ * @param q The queue, with backend, elem_size, lazy, pow2, cells and sizes set.
+ * @return The table the public calls will dispatch through.
+ */
+static const struct queue_ops *select_ops(queue_t q) {
+    switch (q->backend) {
+    case QUEUE_BACKEND_SPSC:
+        return q->pow2 ? &spsc_mask_ops : &spsc_mod_ops;
+    case QUEUE_BACKEND_MPMC:
+        if (q->cells != NULL) {
+            return q->pow2 ? &lossy_mask_ops : &lossy_mod_ops;
+        }
+        return q->pow2 ? &mpmc_mask_ops : &mpmc_mod_ops;
+    case QUEUE_BACKEND_UNBOUNDED:
+        return &unbounded_ops;
+    default:
+        if (q->sizes != NULL) {
+            return &bytes_ops;
+        }
+        if (q->elem_size != 0) {
+            return q->lazy ? &sized_lazy_ops : &sized_ops;
+        }
+        return q->lazy ? &mutex_lazy_ops : &mutex_ops;
+    }
+}
+
+/**
+ * @brief Adds an element to the back of the queue, giving up at deadline.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN or QUEUE_TIMEOUT, or QUEUE_FULL under
+ *         QUEUE_OVERFLOW_REJECT.
+ */
+queue_status_t enqueue_until(queue_t q, void *data, const struct timespec *deadline) {
+    if (q == NULL || data == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->enqueue(q, data, deadline);
+}
+
+/**
+ * @brief Removes the first element in the queue, giving up at deadline.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data on QUEUE_OK.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once shutdown and drained, or QUEUE_TIMEOUT.
+ */
+queue_status_t dequeue_until(queue_t q, void **out, const struct timespec *deadline) {
+    if (q == NULL || out == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->dequeue(q, out, deadline);
+}
+
+/**
+ * @brief Adds an item of the given size, waiting while it would exceed the
+ *        byte budget. Queues without one ignore the size.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @param bytes The memory the item accounts for.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return As enqueue_until.
+ */
+queue_status_t enqueue_bytes(queue_t q, void *data, size_t bytes, const struct timespec *deadline) {
+    if (q == NULL || data == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    if (q->ops != &bytes_ops) {
+        return q->ops->enqueue(q, data, deadline);
+    }
+    return mutex_enqueue(q, data, deadline, false, true, bytes);
+}
+
+/**
+ * @brief Removes the first item, also reporting the size it was enqueued
+ *        with (0 on queues without a byte budget).
+ *
+ * @param q The queue.
+ * @param out Where to store the item on QUEUE_OK.
+ * @param bytes Where to store its size on QUEUE_OK, or NULL.
+ * @param deadline Absolute CLOCK_MONOTONIC deadline, or NULL for none.
+ * @return As dequeue_until.
+ */
+queue_status_t dequeue_bytes(queue_t q, void **out, size_t *bytes, const struct timespec *deadline) {
+    if (q == NULL || out == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    if (q->ops != &bytes_ops) {
+        if (bytes != NULL) {
+            *bytes = 0;
+        }
+        return q->ops->dequeue(q, out, deadline);
+    }
+    return mutex_dequeue(q, out, deadline, false, q->lazy, true, bytes);
+}
+
+/**
+ * @brief Converts a relative timeout into an absolute CLOCK_MONOTONIC deadline.
+ *
+ * @param deadline Where to store the deadline.
+ * @param timeout_ms Milliseconds from now; negative values are treated as 0.
+ */
+static void deadline_after(struct timespec *deadline, long timeout_ms) {
+    if (timeout_ms < 0) {
+        timeout_ms = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * @brief Adds an element to the back of the queue, waiting at most
+ *        timeout_ms milliseconds for space.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @param timeout_ms How long to wait for space.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN or QUEUE_TIMEOUT.
+ */
+queue_status_t enqueue_timeout(queue_t q, void *data, long timeout_ms) {
+    struct timespec deadline;
+    deadline_after(&deadline, timeout_ms);
+    return enqueue_until(q, data, &deadline);
+}
+
+/**
+ * @brief Removes the first element in the queue, waiting at most
+ *        timeout_ms milliseconds for an item.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data on QUEUE_OK.
+ * @param timeout_ms How long to wait for an item.
+ * @return QUEUE_OK, QUEUE_SHUTDOWN once shutdown and drained, or QUEUE_TIMEOUT.
+ */
+queue_status_t dequeue_timeout(queue_t q, void **out, long timeout_ms) {
+    struct timespec deadline;
+    deadline_after(&deadline, timeout_ms);
+    return dequeue_until(q, out, &deadline);
+}
+
+/**
+ * @brief Adds an element to the back of the queue.
+ *        If the queue is full, this call should block until space is available.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ */
+void enqueue(queue_t q, void *data) {
+    enqueue_until(q, data, NULL);
+}
+
+/**
+ * @brief Removes and returns the first element in the queue.
+ *        If the queue is empty, this call should block until an item is available.
+ *        After shutdown, it may return NULL to allow consumers to exit.
+ *
+ * @param q The queue.
+ * @return A pointer to the dequeued data, or NULL if shutdown.
+ */
+void *dequeue(queue_t q) {
+    void *data = NULL;
+    dequeue_until(q, &data, NULL);
+    return data;
+}
+
+/**
+ * @brief Copies an element into the back of a sized queue.
+ *        If the queue is full, this call blocks until space is available.
+ *
+ * @param q A queue created with queue_init_sized.
+ * @param elem The element to copy, elem_size bytes.
+ * @return QUEUE_OK, QUEUE_FULL under QUEUE_OVERFLOW_REJECT, or
+ *         QUEUE_SHUTDOWN if the queue is shut down or not sized.
+ */
+queue_status_t enqueue_copy(queue_t q, const void *elem) {
+    if (q == NULL || elem == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->enqueue_copy(q, (void *)elem, NULL);
+}
+
+/**
+ * @brief Copies the first element of a sized queue out and removes it.
+ *        If the queue is empty, this call blocks until an element is available.
+ *
+ * @param q A queue created with queue_init_sized.
+ * @param out Where to copy the element, elem_size bytes.
+ * @return QUEUE_OK, or QUEUE_SHUTDOWN once shutdown and drained or if the
+ *         queue is not sized.
+ */
+queue_status_t dequeue_copy(queue_t q, void *out) {
+    if (q == NULL || out == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->dequeue_copy(q, out, NULL);
+}
+
+/**
+ * @brief Adds an element to the back of the queue without blocking.
+ *        The mutex backend rejects a full or shutdown queue from an atomic
+ *        pre-check without touching the lock, and never waits for the lock.
+ *
+ * @param q The queue.
+ * @param data The data to add.
+ * @return QUEUE_OK, QUEUE_FULL, QUEUE_SHUTDOWN, or QUEUE_BUSY if the lock
+ *         was held by another thread or a reservation is pending. A NULL queue or item reports
+ *         QUEUE_SHUTDOWN, just as is_shutdown(NULL) is true.
+ */
+queue_status_t try_enqueue(queue_t q, void *data) {
+    if (q == NULL || data == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->enqueue(q, data, NO_WAIT);
+}
+
+/**
+ * @brief Removes the first element in the queue without blocking.
+ *        The mutex backend detects an empty queue from an atomic pre-check
+ *        without touching the lock, and never waits for the lock.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued data on QUEUE_OK.
+ * @return QUEUE_OK, QUEUE_EMPTY, QUEUE_SHUTDOWN once the queue is shutdown
+ *         and drained, or QUEUE_BUSY if the lock was held by another thread
+ *         or a peeked span is pending.
+ */
+queue_status_t try_dequeue(queue_t q, void **out) {
+    if (q == NULL || out == NULL) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->dequeue(q, out, NO_WAIT);
+}
+
+/**
+ * @brief Adds up to n elements to the back of the queue, moving as many
+ *        as fit per lock acquisition (or index update on the lock-free
+ *        backends). Blocks while the queue is full until all n items are
+ *        enqueued.
+ *
+ * @param q The queue.
+ * @param items The items to add, none of which may be NULL.
+ * @param n Number of items.
+ * @return Number of items enqueued; fewer than n only after shutdown.
+ */
+int enqueue_batch(queue_t q, void **items, int n) {
+    if (q == NULL || items == NULL || n <= 0) {
+        return 0;
+    }
+    return q->ops->enqueue_batch(q, items, n);
+}
+
+/**
+ * @brief Removes up to max elements from the front of the queue.
+ *        Blocks until at least min items are available (or shutdown), then
+ *        takes as many as possible, up to max.
+ *
+ * @param q The queue.
+ * @param out Where to store the dequeued items.
+ * @param max Maximum number of items to take.
+ * @param min Number of items to wait for; clamped to [0, max] and to the
+ *            capacity of the queue. Zero never blocks.
+ * @return Number of items dequeued; 0 once the queue is shutdown and drained.
+ */
+int dequeue_batch(queue_t q, void **out, int max, int min) {
+    if (q == NULL || out == NULL || max <= 0) {
+        return 0;
+    }
+    if (min > max) {
+        min = max;
+    }
+    int capacity = q->ops->compact ? ((struct compact_queue *)q)->capacity : q->capacity;
+    if (min > capacity) {
+        min = capacity;
+    }
+    if (min < 0) {
+        min = 0;
+    }
+    return q->ops->dequeue_batch(q, out, max, min);
+}
+
+/**
+ * @brief Describes n slots starting at index, split at the end of the ring
+ *        unless the ring is mirrored.
  *
- * @param capacity The maximum number of items the queue can hold.
- * @return A pointer to the initialized queue.
+ * @param q The queue.
+ * @param index First slot of the span.
+ * @param n Number of slots, at most capacity.
+ * @param span Where to store the description.
  */
-queue_t queue_init(int capacity) {
-    // Ensure capacity is positive value
-    if (capacity <= 0) {
-        return NULL;
+static void span_at(queue_t q, size_t index, int n, queue_span_t *span) {
+    unsigned char *base = q->elem_size != 0 ? q->elems : (unsigned char *)q->buffer;
+    size_t size = q->elem_size != 0 ? q->elem_size : sizeof(void *);
+    size_t run = ring_run(q) - index;
+    int first = run < (size_t)n ? (int)run : n;
+    span->first = base + index * size;
+    span->first_len = first;
+    span->second = n > first ? base : NULL;
+    span->second_len = n - first;
+}
+
+/**
+ * @brief SPSC reserve. Waits until n slots are free, or under
+ *        QUEUE_OVERFLOW_REJECT reports QUEUE_FULL, and lends them out.
+ */
+static queue_status_t spsc_reserve(queue_t q, int n, queue_span_t *span) {
+    if (n > q->capacity) {
+        n = q->capacity;
     }
-    // Allocate memory
-    queue_t q = malloc(sizeof(*q));
-    if (q == NULL) { // Check for allocation failure
-        return NULL;  
+    size_t tail = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+    if (q->reserved > 0 || atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+        return q->reserved > 0 ? QUEUE_BUSY : QUEUE_SHUTDOWN;
     }
-    // Allocate memory for buffer.
-    q->buffer = malloc(sizeof(void *) * capacity);
-    if (q->buffer == NULL) {
-        free(q);
-        return NULL;
+    if ((size_t)q->capacity - (tail - q->cached_head) < (size_t)n) {
+        q->cached_head = atomic_load_explicit(&q->ring_head, memory_order_acquire);
+        if ((size_t)q->capacity - (tail - q->cached_head) < (size_t)n) {
+            if (q->overflow == QUEUE_OVERFLOW_REJECT) {
+                return QUEUE_FULL;
+            }
+            ring_wait(q, &q->not_full, &q->waiting_producers, spsc_not_full, (size_t)n, NULL);
+            if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+                return QUEUE_SHUTDOWN;
+            }
+            q->cached_head = atomic_load_explicit(&q->ring_head, memory_order_acquire);
+        }
     }
-    // Set values
-    q->capacity = capacity;
-    q->count = 0;
-    q->head = 0;
-    q->tail = 0;
-    q->shutdown = false;
-    // Handle mutex for thread safety, create condition variables, then return. 
-    pthread_mutex_init(&q->lock, NULL);
-    pthread_cond_init(&q->not_full, NULL); // producers wait if queue is full
-    pthread_cond_init(&q->not_empty, NULL); // consumers wait if queue is empty
-    return q;
+    q->reserved = n;
+    span_at(q, ring_index(q, tail), n, span);
+    return QUEUE_OK;
 }
 
 /**
- * @brief Internal helper function to handle shutdown signaling.
- *        Sets the shutdown flag and broadcasts to both condition variables
- *        to ensure all waiting producer and consumer threads are woken up.
+ * @brief SPSC commit. The producer owns the tail, so publishing is one
+ *        release store.
+ */
+static queue_status_t spsc_commit(queue_t q, int n) {
+    if (n > q->reserved) {
+        n = q->reserved;
+    }
+    q->reserved = 0;
+    if (atomic_load_explicit(&q->shutdown, memory_order_relaxed)) {
+        return QUEUE_SHUTDOWN;
+    }
+    size_t tail = atomic_load_explicit(&q->ring_tail, memory_order_relaxed);
+    if (q->counters != NULL && n > 0) {
+        stats_enqueued(q, ring_index(q, tail), (size_t)n, ring_count(q) + n);
+    }
+    atomic_store_explicit(&q->ring_tail, tail + (size_t)n, memory_order_release);
+    probe_ring("enqueue", q, n);
+    ring_wake(q, &q->not_empty, &q->waiting_consumers);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief SPSC peek. Waits for at least one item and lends out up to max.
+ */
+static queue_status_t spsc_peek_span(queue_t q, int max, queue_span_t *span) {
+    size_t head = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+    if (q->peeked > 0) {
+        return QUEUE_BUSY;
+    }
+    if (q->cached_tail - head < (size_t)max) {
+        q->cached_tail = atomic_load_explicit(&q->ring_tail, memory_order_acquire);
+    }
+    if (q->cached_tail == head) {
+        ring_wait(q, &q->not_empty, &q->waiting_consumers, spsc_not_empty, 1, NULL);
+        q->cached_tail = atomic_load_explicit(&q->ring_tail, memory_order_acquire);
+        if (q->cached_tail == head) {
+            return QUEUE_SHUTDOWN;
+        }
+    }
+    size_t n = q->cached_tail - head;
+    q->peeked = n < (size_t)max ? (int)n : max;
+    span_at(q, ring_index(q, head), q->peeked, span);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief SPSC release. The consumer owns the head, so consuming is one
+ *        release store.
+ */
+static void spsc_release(queue_t q, int n) {
+    if (n > q->peeked) {
+        n = q->peeked;
+    }
+    size_t head = atomic_load_explicit(&q->ring_head, memory_order_relaxed);
+    q->peeked = 0;
+    if (q->counters != NULL && n > 0) {
+        stats_dequeued(q, ring_index(q, head), (size_t)n);
+    }
+    atomic_store_explicit(&q->ring_head, head + (size_t)n, memory_order_release);
+    probe_ring("dequeue", q, n);
+    ring_wake(q, &q->not_full, &q->waiting_producers);
+}
+
+/**
+ * @brief Mutex backend reserve. Only one reservation is pending at a
+ *        time: other producers, reserving or not, wait until it is
+ *        committed, which keeps the items in FIFO order.
+ */
+static queue_status_t mutex_reserve(queue_t q, int n, queue_span_t *span) {
+    if (n > q->capacity) {
+        n = q->capacity;
+    }
+    uint64_t waited = 0;
+    queue_lock(q, LOCK_ENQUEUE);
+    if (q->overflow == QUEUE_OVERFLOW_REJECT && !q->shutdown &&
+        (q->reserved > 0 || q->capacity - q->count < n)) {
+        queue_unlock(q);
+        return QUEUE_FULL;
+    }
+    while ( (q->reserved > 0 || q->capacity - q->count < n) && !q->shutdown ) {
+        if (waited == 0) {
+            waited = stats_clock(q, true);
+        }
+        park(q, &q->not_full, &q->producers, NULL);
+        // A wake-up for a slot this reservation cannot use yet goes on to
+        // the plain producers, which can.
+        if (q->reserved == 0 && q->capacity - q->count < n && !q->shutdown) {
+            unpark(q, &q->not_full, &q->producers, q->capacity - q->count);
+        }
+    }
+    stats_waited(q, true, waited);
+    if (q->shutdown) {
+        queue_unlock(q);
+        return QUEUE_SHUTDOWN;
+    }
+    q->reserved = n;
+    span_at(q, (size_t)q->tail, n, span);
+    queue_unlock(q);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Mutex backend commit; lets every producer the reservation held
+ *        back re-check.
+ */
+static queue_status_t mutex_commit(queue_t q, int n) {
+    queue_status_t status = QUEUE_OK;
+    queue_lock(q, LOCK_ENQUEUE);
+    if (n > q->reserved) {
+        n = q->reserved;
+    }
+    if (q->shutdown) {
+        status = QUEUE_SHUTDOWN;
+    } else if (n > 0) {
+        if (q->counters != NULL) {
+            stats_enqueued(q, (size_t)q->tail, (size_t)n, q->count + n);
+        }
+        q->tail = ring_advance(q, q->tail, n);
+        count_add(q, n);
+        probe_count("enqueue", q, n, q->count);
+        unpark(q, &q->not_empty, &q->consumers, n);
+    }
+    q->reserved = 0;
+    // Every producer held back by the reservation gets to re-check.
+    unpark(q, &q->not_full, &q->producers, q->producers.sleeping);
+    queue_unlock(q);
+    return status;
+}
+
+/**
+ * @brief Mutex backend peek; other consumers wait until the span is
+ *        released.
+ */
+static queue_status_t mutex_peek_span(queue_t q, int max, queue_span_t *span) {
+    uint64_t waited = 0;
+    queue_lock(q, LOCK_DEQUEUE);
+    while ( q->peeked > 0 || ((q->count == 0) && !q->shutdown) ) {
+        if (waited == 0) {
+            waited = stats_clock(q, false);
+        }
+        park(q, &q->not_empty, &q->consumers, NULL);
+    }
+    stats_waited(q, false, waited);
+    if (q->count == 0) {
+        queue_unlock(q);
+        return QUEUE_SHUTDOWN;
+    }
+    q->peeked = q->count < max ? q->count : max;
+    span_at(q, (size_t)q->head, q->peeked, span);
+    queue_unlock(q);
+    return QUEUE_OK;
+}
+
+/**
+ * @brief Mutex backend release; lets every consumer the span held back
+ *        re-check.
+ */
+static void mutex_release(queue_t q, int n) {
+    queue_lock(q, LOCK_DEQUEUE);
+    if (n > q->peeked) {
+        n = q->peeked;
+    }
+    if (n > 0) {
+        if (q->counters != NULL) {
+            stats_dequeued(q, (size_t)q->head, (size_t)n);
+        }
+        q->head = ring_advance(q, q->head, n);
+        count_add(q, -n);
+        probe_count("dequeue", q, n, q->count);
+        if (q->lazy) {
+            lazy_dequeued(q, n);
+        }
+        unpark(q, &q->not_full, &q->producers, n);
+    }
+    q->peeked = 0;
+    // Every consumer held back by the span gets to re-check.
+    unpark(q, &q->not_empty, &q->consumers, q->consumers.sleeping);
+    queue_unlock(q);
+}
+
+/**
+ * @brief Reserves n free slots at the tail so the caller can write items
+ *        (pointers, or elements of a sized queue) straight into the ring.
+ *        Blocks until n slots are free. Only one reservation is pending at
+ *        a time: on the mutex backend other producers, reserving or not,
+ *        wait until it is committed, which keeps the items in FIFO order.
  *
- * @param q The queue to signal shutdown on.
+ * @param q The queue (mutex or SPSC backend).
+ * @param n Number of slots; clamped to the capacity of the queue.
+ * @param span Where to store the reserved slots.
+ * @return QUEUE_OK, or QUEUE_SHUTDOWN if the queue is (or gets) shut down
+ *         or is an MPMC queue. The SPSC backend reports QUEUE_BUSY if its
+ *         producer already holds a reservation. Under QUEUE_OVERFLOW_REJECT
+ *         QUEUE_FULL replaces every wait.
  */
-static void signal_shutdown(queue_t q) {
-    // Set shutdown flag to true so waiting threads can know to exit.
-    q->shutdown = true;
-    // Wake up all threads waiting on not_full (producers) and not_empty (consumers).
-    pthread_cond_broadcast(&q->not_full);
-    pthread_cond_broadcast(&q->not_empty);
+queue_status_t queue_reserve(queue_t q, int n, queue_span_t *span) {
+    if (q == NULL || span == NULL || n <= 0) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->reserve(q, n, span);
 }
 
 /**
- * @brief Frees all resources associated with the queue.
- *        Should signal all waiting threads so they can exit properly.
+ * @brief Publishes the first n slots of the pending reservation in FIFO
+ *        order and gives the rest back. A reservation interrupted by
+ *        queue_shutdown is discarded, like an enqueue after shutdown.
  *
- * @param q The queue to destroy.
+ * @param q The queue.
+ * @param n Number of slots written; clamped to the reservation.
+ * @return QUEUE_OK, or QUEUE_SHUTDOWN if nothing could be published
+ *         because the queue was shut down.
  */
-void queue_destroy(queue_t q) {
-    // Nothing to destroy if queue is NULL
+queue_status_t queue_commit(queue_t q, int n) {
     if (q == NULL) {
-        return;
+        return QUEUE_SHUTDOWN;
     }
-    // Lock the mutex to safely update shared data.
-    pthread_mutex_lock(&q->lock);
-    // Signal shutdown
-    signal_shutdown(q);
-    // Unlock the mutex after setting shutdown and signaling condition variables.
-    pthread_mutex_unlock(&q->lock);
-    // Destroy the mutex and condition variables now that no threads should be waiting.
-    pthread_mutex_destroy(&q->lock);
-    pthread_cond_destroy(&q->not_full);
-    pthread_cond_destroy(&q->not_empty);
-    // Free the circular buffer and the queue structure itself.
-    free(q->buffer);
-    free(q);
+    return q->ops->commit(q, n < 0 ? 0 : n);
 }
 
 /**
- * @brief Adds an element to the back of the queue.
- *        If the queue is full, this call should block until space is available.
+ * @brief Lends out up to max items at the head so the caller can read them
+ *        in place. Blocks until at least one item is available. The items
+ *        stay queued until queue_release; on the mutex backend other
+ *        consumers wait meanwhile.
+ *
+ * @param q The queue (mutex or SPSC backend).
+ * @param max Maximum number of items to lend out.
+ * @param span Where to store the items.
+ * @return QUEUE_OK, or QUEUE_SHUTDOWN once the queue is shutdown and
+ *         drained or is an MPMC queue. The SPSC backend reports QUEUE_BUSY
+ *         if its consumer already holds a span.
+ */
+queue_status_t queue_peek_span(queue_t q, int max, queue_span_t *span) {
+    if (q == NULL || span == NULL || max <= 0) {
+        return QUEUE_SHUTDOWN;
+    }
+    return q->ops->peek_span(q, max, span);
+}
+
+/**
+ * @brief Removes the first n items of the pending peeked span; the rest
+ *        stay at the head of the queue.
  *
  * @param q The queue.
- * @param data The data to add.
+ * @param n Number of items consumed; clamped to the span.
  */
-void enqueue(queue_t q, void *data) {
-    // Do nothing if the queue or data is invalid.
-    if (q == NULL || data == NULL) {
+void queue_release(queue_t q, int n) {
+    if (q == NULL) {
         return;
     }
-    // Lock the mutex to safely access shared data.
-    pthread_mutex_lock(&q->lock);
-    // Wait while the queue is full and shutdown has NOT been called.
-    while ( (q->count == q->capacity) && !q->shutdown ) {
-        pthread_cond_wait(&q->not_full, &q->lock); // release the mutex while waiting, re-locks it after signaled.
+    q->ops->release(q, n < 0 ? 0 : n);
+}
+
+/**
+ * @brief Counts the bytes of [addr, addr + len) that are resident in memory.
+ *
+ * @param addr Start of the range, any alignment.
+ * @param len Length of the range in bytes.
+ * @return Resident bytes, in whole pages; 0 if mincore fails.
+ */
+static size_t resident_bytes(const void *addr, size_t len) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t lo = (uintptr_t)addr / page * page;
+    uintptr_t hi = ((uintptr_t)addr + len + page - 1) / page * page;
+    size_t pages = (hi - lo) / page;
+    unsigned char *vec = malloc(pages > 0 ? pages : 1);
+    size_t resident = 0;
+    if (vec != NULL && mincore((void *)lo, hi - lo, vec) == 0) {
+        for (size_t i = 0; i < pages; i++) {
+            resident += vec[i] & 1;
+        }
     }
-    // If shutdown was called while waiting, exit early.
-    if (q->shutdown) {
-        pthread_mutex_unlock(&q->lock);
+    free(vec);
+    return resident * page;
+}
+
+/**
+ * @brief Fills in what every ring reports the same way: its size, how
+ *        much of it is resident and the overflow and byte counters.
+ *
+ * @param q The queue.
+ * @param stats The zeroed snapshot.
+ * @param count Items queued.
+ * @param elem Bytes per slot.
+ * @param ring First slot.
+ */
+static void ring_stats(queue_t q, queue_stats_t *stats, int count, size_t elem, const void *ring) {
+    stats->capacity = q->capacity;
+    stats->count = count;
+    stats->ring_bytes = elem * (size_t)q->capacity;
+    stats->resident_bytes = resident_bytes(ring, stats->ring_bytes);
+    stats->rejected = atomic_load_explicit(&q->rejected, memory_order_relaxed);
+    stats->evicted = atomic_load_explicit(&q->evicted, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&q->bytes, memory_order_relaxed);
+    stats->peak_bytes = atomic_load_explicit(&q->peak_bytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Stats entries of the ops tables, one per ring layout.
+ */
+static void mutex_stats(queue_t q, queue_stats_t *stats) {
+    ring_stats(q, stats, atomic_load_explicit(&q->count, memory_order_relaxed), sizeof(void *),
+               q->buffer);
+}
+
+static void sized_stats(queue_t q, queue_stats_t *stats) {
+    ring_stats(q, stats, atomic_load_explicit(&q->count, memory_order_relaxed), q->elem_size,
+               q->elems);
+}
+
+static void spsc_stats(queue_t q, queue_stats_t *stats) {
+    ring_stats(q, stats, ring_count(q), sizeof(void *), q->buffer);
+}
+
+static void mpmc_stats(queue_t q, queue_stats_t *stats) {
+    ring_stats(q, stats, ring_count(q), sizeof(struct ring_slot), q->slots);
+}
+
+static void lossy_stats(queue_t q, queue_stats_t *stats) {
+    ring_stats(q, stats, ring_count(q), sizeof(struct lossy_cell), q->cells);
+}
+
+static void unbounded_stats(queue_t q, queue_stats_t *stats) {
+    // Segments come from malloc, so count them all as resident.
+    stats->capacity = q->capacity;
+    stats->count = atomic_load_explicit(&q->count, memory_order_relaxed);
+    stats->ring_bytes = atomic_load_explicit(&q->segments, memory_order_relaxed) * sizeof(struct segment);
+    stats->resident_bytes = stats->ring_bytes;
+}
+
+static void compact_stats(queue_t q, queue_stats_t *stats) {
+    struct compact_queue *cq = (struct compact_queue *)q;
+    word_lock(&cq->lock);
+    stats->count = cq->count;
+    word_unlock(&cq->lock);
+    stats->capacity = cq->capacity;
+    stats->ring_bytes = (size_t)cq->capacity * sizeof(void *);
+    stats->resident_bytes = resident_bytes(cq->slots, stats->ring_bytes);
+}
+
+/**
+ * @brief Fills in a snapshot of the queue's occupancy, memory use and
+ *        overflow drops.
+ *
+ * @param q The queue.
+ * @param stats Where to store the snapshot.
+ */
+void queue_stats(queue_t q, queue_stats_t *stats) {
+    if (q == NULL || stats == NULL) {
         return;
     }
-    // Add the data to the tail of the buffer.
-    q->buffer[q->tail] = data;
-    q->tail = (q->tail+1) % q->capacity; // Wrap around (circular buffer).
-    q->count++; // Increase the count of items in the queue.
-    // Signal to waiting consumer if the queue was empty before this enqueue,
-    if (q->count == 1) {
-        pthread_cond_signal(&q->not_empty);
+    memset(stats, 0, sizeof(*stats));
+    q->ops->stats(q, stats);
+}
+
+/**
+ * @brief Copies a stats block into snap with relaxed loads. The block may
+ *        be in a read-only mapping of another process's registry.
+ */
+static void counters_snapshot(const struct queue_counters *c, queue_snapshot_t *snap) {
+    snap->enqueued = atomic_load_explicit(&c->enqueued, memory_order_relaxed);
+    snap->dequeued = atomic_load_explicit(&c->dequeued, memory_order_relaxed);
+    snap->full_waits = atomic_load_explicit(&c->full_waits, memory_order_relaxed);
+    snap->empty_waits = atomic_load_explicit(&c->empty_waits, memory_order_relaxed);
+    snap->enqueue_wait_ns = atomic_load_explicit(&c->enqueue_wait_ns, memory_order_relaxed);
+    snap->dequeue_wait_ns = atomic_load_explicit(&c->dequeue_wait_ns, memory_order_relaxed);
+    snap->peak_count = atomic_load_explicit(&c->peak_count, memory_order_relaxed);
+    snap->blocked_producers = atomic_load_explicit(&c->blocked_producers, memory_order_relaxed);
+    snap->blocked_consumers = atomic_load_explicit(&c->blocked_consumers, memory_order_relaxed);
+    for (int i = 0; i < QUEUE_LATENCY_BUCKETS; i++) {
+        snap->latency[i] = atomic_load_explicit(&c->latency[i], memory_order_relaxed);
     }
-    // Unlock the mutex when done modifying the queue.
-    pthread_mutex_unlock(&q->lock);
 }
 
 /**
- * @brief Removes and returns the first element in the queue.
- *        If the queue is empty, this call should block until an item is available.
- *        After shutdown, it may return NULL to allow consumers to exit.
+ * @brief Copies the stats block of the queue with relaxed loads, taking
+ *        no lock.
  *
  * @param q The queue.
- * @return A pointer to the dequeued data, or NULL if shutdown.
+ * @param snap Where to store the counters.
+ * @return False if the queue keeps no stats block.
  */
-void *dequeue(queue_t q) {
-    // Ensure queue validity
-    if (q == NULL) {
+bool queue_stats_snapshot(queue_t q, queue_snapshot_t *snap) {
+    if (snap == NULL) {
+        return false;
+    }
+    memset(snap, 0, sizeof(*snap));
+    if (q == NULL || q->ops->compact || q->counters == NULL) {
+        return false;
+    }
+    counters_snapshot(q->counters, snap);
+    return true;
+}
+
+/**
+ * @brief Lower bound of a time-in-queue bucket; the inverse of
+ *        latency_bucket.
+ *
+ * @param bucket The bucket, clamped to [0, QUEUE_LATENCY_BUCKETS).
+ * @return The shortest time in nanoseconds that lands in it.
+ */
+unsigned long long queue_latency_bucket_ns(int bucket) {
+    if (bucket < 0) {
+        bucket = 0;
+    }
+    if (bucket >= QUEUE_LATENCY_BUCKETS) {
+        bucket = QUEUE_LATENCY_BUCKETS - 1;
+    }
+    if (bucket < 8) {
+        return (unsigned long long)bucket;
+    }
+    int e = (bucket >> 3) + 2;
+    return (8ULL + (unsigned long long)(bucket & 7)) << (e - 3);
+}
+
+/**
+ * @brief Walks the histogram of a snapshot to the bucket holding the
+ *        given percentile of the dequeued items.
+ *
+ * @param snap The snapshot.
+ * @param percent The percentile, clamped to [0, 100].
+ * @return The upper bound of that bucket in nanoseconds (the lower bound
+ *         for the open-ended last one), or 0 for an empty histogram.
+ */
+unsigned long long queue_latency_percentile(const queue_snapshot_t *snap, double percent) {
+    if (snap == NULL) {
+        return 0;
+    }
+    size_t total = 0;
+    for (int i = 0; i < QUEUE_LATENCY_BUCKETS; i++) {
+        total += snap->latency[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    percent = percent < 0 ? 0 : percent > 100 ? 100 : percent;
+    size_t rank = (size_t)(percent / 100 * (double)total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    size_t seen = 0;
+    int bucket = 0;
+    while (bucket < QUEUE_LATENCY_BUCKETS - 1 && (seen += snap->latency[bucket]) < rank) {
+        bucket++;
+    }
+    return queue_latency_bucket_ns(bucket < QUEUE_LATENCY_BUCKETS - 1 ? bucket + 1 : bucket);
+}
+
+/**
+ * @brief Lists the pids behind the /queuetop.<pid> segments in /dev/shm,
+ *        where Linux keeps POSIX shared memory.
+ *
+ * @param pids Where to store the pids.
+ * @param max Room in pids.
+ * @return Number of pids stored.
+ */
+int queue_registry_list(int *pids, int max) {
+    DIR *dir = opendir("/dev/shm");
+    if (dir == NULL || pids == NULL) {
+        if (dir != NULL) {
+            closedir(dir);
+        }
+        return 0;
+    }
+    int n = 0;
+    struct dirent *entry;
+    while (n < max && (entry = readdir(dir)) != NULL) {
+        int pid;
+        char end;
+        if (sscanf(entry->d_name, "queuetop.%d%c", &pid, &end) == 1 && pid > 0) {
+            pids[n++] = pid;
+        }
+    }
+    closedir(dir);
+    return n;
+}
+
+/**
+ * @brief Maps pid's registry read-only, checking it has this layout.
+ *
+ * @param pid The process.
+ * @return The registry, or NULL if there is none or it does not match.
+ */
+queue_registry_t queue_registry_open(int pid) {
+    char name[32];
+    registry_name(name, sizeof(name), pid);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
         return NULL;
     }
-    // Lock the mutex to safely access shared data.
-    pthread_mutex_lock(&q->lock);
-    // Wait while the queue is empty and shutdown has NOT been called.
-    while ( (q->count == 0) && !q->shutdown ) {
-        pthread_cond_wait(&q->not_empty, &q->lock); // release the mutex while waiting, re-locks it after signaled.
+    struct stat st;
+    const struct registry *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == sizeof(struct registry)) {
+        map = mmap(NULL, sizeof(struct registry), PROT_READ, MAP_SHARED, fd, 0);
     }
-    // If shutdown was called and the queue is empty, exit and return NULL.
-    if ( q->shutdown && (q->count == 0) ) {
-        pthread_mutex_unlock(&q->lock);
+    close(fd);
+    if (map == MAP_FAILED) {
         return NULL;
     }
-    // Remove the item from the head of the buffer.
-    void *data = q->buffer[q->head];
-    q->head = (q->head+1) % q->capacity; // Wrap around (circular buffer).
-    q->count--; // Decrease the count of items in the queue.
-    // Signal to waiting producers if the queue was full before this dequeue,
-    if (q->count == q->capacity - 1) {
-        pthread_cond_signal(&q->not_full);
+    queue_registry_t reg = malloc(sizeof(*reg));
+    if (reg == NULL || atomic_load_explicit(&map->magic, memory_order_acquire) != REGISTRY_MAGIC ||
+        map->size != sizeof(struct registry)) {
+        free(reg);
+        munmap((void *)map, sizeof(struct registry));
+        return NULL;
+    }
+    reg->map = map;
+    return reg;
+}
+
+/**
+ * @brief Copies every LIVE slot of the registry, retrying none: a slot
+ *        whose generation or state moved while it was copied is skipped.
+ *
+ * @param reg The registry.
+ * @param entries Where to store the queues.
+ * @param max Room in entries.
+ * @return Number of entries stored.
+ */
+int queue_registry_read(queue_registry_t reg, queue_registry_entry_t *entries, int max) {
+    if (reg == NULL || entries == NULL) {
+        return 0;
+    }
+    int n = 0;
+    for (int i = 0; i < REGISTRY_SLOTS && n < max; i++) {
+        const struct registry_slot *slot = &reg->map->slots[i];
+        unsigned generation = atomic_load_explicit(&slot->generation, memory_order_acquire);
+        if (atomic_load_explicit(&slot->state, memory_order_acquire) != SLOT_LIVE) {
+            continue;
+        }
+        queue_registry_entry_t *e = &entries[n];
+        memcpy(e->name, slot->name, sizeof(e->name));
+        e->name[sizeof(e->name) - 1] = '\0';
+        e->capacity = slot->capacity;
+        e->backend = (queue_backend_t)slot->backend;
+        counters_snapshot(&slot->counters, &e->stats);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->state, memory_order_relaxed) == SLOT_LIVE &&
+            atomic_load_explicit(&slot->generation, memory_order_relaxed) == generation) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Unmaps a registry.
+ *
+ * @param reg The registry, or NULL.
+ */
+void queue_registry_close(queue_registry_t reg) {
+    if (reg == NULL) {
+        return;
+    }
+    munmap((void *)reg->map, sizeof(struct registry));
+    free(reg);
+}
+
+/**
+ * @brief Copies the lock profile of the queue under its lock.
+ *
+ * @param q The queue.
+ * @param sites Where to store the profile, one entry per lock site.
+ * @return true if filled in; false, with sites zeroed, unless built with
+ *         -DQUEUE_LOCK_PROFILE and q is a lock-based queue.
+ */
+bool queue_lock_profile(queue_t q, queue_lock_stats_t sites[QUEUE_LOCK_SITES]) {
+    if (sites == NULL) {
+        return false;
+    }
+    memset(sites, 0, sizeof(queue_lock_stats_t) * QUEUE_LOCK_SITES);
+#ifdef QUEUE_LOCK_PROFILE
+    if (q == NULL || q->ops->compact) {
+        return false;
+    }
+    pthread_mutex_lock(&q->lock);
+    for (int i = 0; i < LOCK_SITES; i++) {
+        const struct lock_site_stats *s = &q->profile.sites[i];
+        sites[i] = (queue_lock_stats_t){
+            .acquires = s->acquires,
+            .contended = s->contended,
+            .trylock_failures = atomic_load_explicit(&s->trylock_failures, memory_order_relaxed),
+            .acquire_ns = s->acquire_ns,
+            .acquire_max_ns = s->acquire_max_ns,
+            .hold_ns = s->hold_ns,
+            .hold_max_ns = s->hold_max_ns,
+            .wakeups = s->wakeups,
+            .wake_ns = s->wake_ns,
+            .wake_max_ns = s->wake_max_ns,
+        };
     }
-    // Unlock the mutex when done modifying the queue.
     pthread_mutex_unlock(&q->lock);
-    return data; // Return the dequeued item.
+    return true;
+#else
+    (void)q;
+    return false;
+#endif
+}
+
+/**
+ * @brief Prints the lock profile of the queue to stderr: per call site,
+ *        how often q->lock was taken and contended, the mean and worst
+ *        time to acquire and to hold it, trylock failures and the mean and
+ *        worst wake-to-run latency of its condition waits. Copies the
+ *        profile with queue_lock_profile, so it can run while the queue is
+ *        in use. Does nothing unless built with -DQUEUE_LOCK_PROFILE.
+ *
+ * @param q The queue.
+ */
+void queue_lock_profile_dump(queue_t q) {
+    static const char *const names[QUEUE_LOCK_SITES] = {"enqueue", "dequeue", "is_empty",
+                                                        "is_shutdown", "shutdown"};
+    queue_lock_stats_t sites[QUEUE_LOCK_SITES];
+    if (!queue_lock_profile(q, sites)) {
+        return;
+    }
+    fprintf(stderr, "lock profile of queue %p (ns)\n", (void *)q);
+    fprintf(stderr, "%-12s %10s %10s %8s %10s %10s %10s %10s %10s %10s %10s\n", "site", "acquires",
+            "contended", "tryfail", "acq avg", "acq max", "hold avg", "hold max", "wakeups", "wake avg",
+            "wake max");
+    for (int i = 0; i < QUEUE_LOCK_SITES; i++) {
+        const queue_lock_stats_t *s = &sites[i];
+        if (s->acquires == 0 && s->trylock_failures == 0) {
+            continue;
+        }
+        unsigned long long acquires = s->acquires > 0 ? s->acquires : 1;
+        unsigned long long wakeups = s->wakeups > 0 ? s->wakeups : 1;
+        fprintf(stderr, "%-12s %10llu %10llu %8llu %10llu %10llu %10llu %10llu %10llu %10llu %10llu\n", names[i],
+                s->acquires, s->contended, s->trylock_failures, s->acquire_ns / acquires,
+                s->acquire_max_ns, s->hold_ns / acquires, s->hold_max_ns, s->wakeups,
+                s->wake_ns / wakeups, s->wake_max_ns);
+    }
 }
 
 /**
@@ -183,12 +5220,41 @@ void queue_shutdown(queue_t q) {
     if (q == NULL) {
         return;
     }
+    if (q->ops->compact) {
+        compact_shutdown((struct compact_queue *)q);
+        return;
+    }
     // Lock the mutex to safely update shared data.
-    pthread_mutex_lock(&q->lock);
+    queue_lock(q, LOCK_SHUTDOWN);
     // Signal shutdown
     signal_shutdown(q);
     // Unlock the mutex after updating the shutdown flag and signaling threads.
-    pthread_mutex_unlock(&q->lock);
+    queue_unlock(q);
+}
+
+/**
+ * @brief Emptiness entries of the ops tables.
+ */
+static bool mutex_is_empty(queue_t q) {
+    // Lock the mutex to safely read shared data.
+    queue_lock(q, LOCK_IS_EMPTY);
+    // Check if the number of items in the queue is zero.
+    bool result = (q->count == 0);
+    // Unlock the mutex after reading the shared data.
+    queue_unlock(q);
+    return result; // Return whether the queue is empty.
+}
+
+static bool ring_is_empty(queue_t q) {
+    return ring_empty(q);
+}
+
+static bool compact_is_empty(queue_t q) {
+    struct compact_queue *cq = (struct compact_queue *)q;
+    word_lock(&cq->lock);
+    bool empty = cq->count == 0;
+    word_unlock(&cq->lock);
+    return empty;
 }
 
 /**
@@ -201,13 +5267,7 @@ bool is_empty(queue_t q) {
     if (q == NULL) {
         return true;
     }
-    // Lock the mutex to safely read shared data.
-    pthread_mutex_lock(&q->lock);
-    // Check if the number of items in the queue is zero.
-    bool result = (q->count == 0);
-    // Unlock the mutex after reading the shared data.
-    pthread_mutex_unlock(&q->lock);
-    return result; // Return whether the queue is empty.
+    return q->ops->is_empty(q);
 }
 
 /**
@@ -220,11 +5280,14 @@ bool is_shutdown(queue_t q) {
     if (q == NULL) {
         return true;
     }
+    if (q->ops->compact) {
+        return atomic_load(&((struct compact_queue *)q)->shutdown);
+    }
     // Lock the mutex to safely read the shutdown flag.
-    pthread_mutex_lock(&q->lock);
+    queue_lock(q, LOCK_IS_SHUTDOWN);
     // Check the shutdown flag.
     bool result = q->shutdown;
     // Unlock the mutex after reading the flag.
-    pthread_mutex_unlock(&q->lock);
+    queue_unlock(q);
     return result; // Return whether shutdown has been set.
 }
\ No newline at end of file
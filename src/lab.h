@@ -2,6 +2,7 @@
 #define LAB_H
 #include <stdlib.h>
 #include <stdbool.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -13,14 +14,590 @@ extern "C"
      */
     typedef struct queue *queue_t;
 
+    /**
+     * @brief Result of the non-blocking queue operations
+     */
+    typedef enum queue_status
+    {
+        QUEUE_OK,       /* the item was added or removed */
+        QUEUE_FULL,     /* no free slot; nothing was added */
+        QUEUE_EMPTY,    /* no item available; nothing was removed */
+        QUEUE_SHUTDOWN, /* the queue is shutdown (and, for removal, drained) */
+        QUEUE_BUSY,     /* another thread held the lock; nothing was done */
+        QUEUE_TIMEOUT,  /* the deadline passed before the operation could complete */
+    } queue_status_t;
+
+    /**
+     * @brief A run of slots lent out by queue_reserve or queue_peek_span
+     *
+     * The slots hold void pointers, or elements of elem_size bytes for a
+     * queue_init_sized queue. A run that crosses the end of the ring is
+     * split in two; second is NULL and second_len 0 when it does not.
+     */
+    typedef struct queue_span
+    {
+        void *first;    /* first slot of the run */
+        int first_len;  /* slots from first up to the end of the ring */
+        void *second;   /* continuation at the start of the ring, or NULL */
+        int second_len; /* slots from second */
+    } queue_span_t;
+
+    /**
+     * @brief NUMA policy for the memory of a queue's ring
+     */
+    typedef enum queue_numa_policy
+    {
+        QUEUE_NUMA_DEFAULT,    /* first touch decides, as for malloc */
+        QUEUE_NUMA_BIND,       /* allocate only on the given node */
+        QUEUE_NUMA_INTERLEAVE, /* spread pages over all allowed nodes */
+    } queue_numa_policy_t;
+
+    /**
+     * @brief Where queue_init_placed puts the ring
+     */
+    typedef struct queue_placement
+    {
+        bool huge_pages;            /* request transparent huge pages */
+        queue_numa_policy_t policy; /* NUMA policy for the ring */
+        int node;                   /* node for QUEUE_NUMA_BIND */
+    } queue_placement_t;
+
+    /**
+     * @brief Snapshot of a queue filled in by queue_stats
+     */
+    typedef struct queue_stats
+    {
+        int capacity;          /* maximum number of items, INT_MAX if unbounded */
+        int count;             /* items queued when the snapshot was taken */
+        size_t ring_bytes;     /* bytes of address space used by the ring */
+        size_t resident_bytes; /* bytes of the ring backed by memory, in pages */
+        size_t rejected;       /* new items refused by QUEUE_OVERFLOW_REJECT */
+        size_t evicted;        /* old items pushed out by EVICT or OVERWRITE */
+        size_t bytes;          /* byte-bounded queues: bytes of the queued items */
+        size_t peak_bytes;     /* byte-bounded queues: most bytes ever queued */
+    } queue_stats_t;
+
+    /**
+     * @brief Buckets of the time-in-queue histogram in queue_snapshot_t
+     *
+     * Log-linear, in the style of an HDR histogram: times below 8 ns get a
+     * bucket each, then every power of two is split into 8 equal buckets,
+     * so a bucket is at most 12.5% wide. The last bucket also collects
+     * everything from about 18 minutes up. queue_latency_bucket_ns gives
+     * the lower bound of a bucket.
+     */
+#define QUEUE_LATENCY_BUCKETS 304
+
+    /**
+     * @brief Counters of a queue created with queue_attr_setstats, filled
+     * in by queue_stats_snapshot
+     *
+     * Every field is read on its own while the queue keeps running, so
+     * they may disagree by the operations in flight.
+     */
+    typedef struct queue_snapshot
+    {
+        size_t enqueued;                     /* items that entered the queue */
+        size_t dequeued;                     /* items that left it, evicted ones included */
+        size_t full_waits;                   /* enqueues that had to wait for room */
+        size_t empty_waits;                  /* dequeues that had to wait for an item */
+        unsigned long long enqueue_wait_ns;  /* time producers spent in those waits */
+        unsigned long long dequeue_wait_ns;  /* time consumers spent in those waits */
+        int peak_count;                      /* most items ever queued at once */
+        int blocked_producers;               /* producers waiting right now */
+        int blocked_consumers;               /* consumers waiting right now */
+        size_t latency[QUEUE_LATENCY_BUCKETS]; /* dequeued items by time spent queued */
+    } queue_snapshot_t;
+
+    /**
+     * @brief How a thread waits on a full or empty queue before it parks
+     *
+     * A waiter first busy-waits up to spin iterations with a CPU pause
+     * hint, then calls sched_yield up to yield times, and only then blocks
+     * on the condition variable or futex. With adaptive set, the spin
+     * budget is tuned between a small floor and spin from how recent waits
+     * ended. All zero (the default) parks immediately.
+     */
+    typedef struct queue_wait_strategy
+    {
+        int spin;      /* maximum pause-spin iterations */
+        int yield;     /* sched_yield rounds after spinning */
+        bool adaptive; /* tune the spin budget from recent waits */
+    } queue_wait_strategy_t;
+
+    /**
+     * @brief The implementation serving a queue's operations
+     */
+    typedef enum queue_backend
+    {
+        QUEUE_BACKEND_MUTEX, /* monitor: one mutex and two condition variables */
+        QUEUE_BACKEND_SPSC,  /* single-producer/single-consumer lock-free ring */
+        QUEUE_BACKEND_MPMC,  /* multi-producer/multi-consumer lock-free ring */
+        QUEUE_BACKEND_COMPACT, /* one-word lock, waiters in a global parking lot */
+        QUEUE_BACKEND_UNBOUNDED, /* linked array segments, never full */
+    } queue_backend_t;
+
+    /**
+     * @brief How the mutex backend parks blocked threads
+     */
+    typedef enum queue_parking
+    {
+        QUEUE_PARK_CONDVAR, /* pthread condition variables */
+        QUEUE_PARK_FUTEX,   /* futex words, Linux only */
+    } queue_parking_t;
+
+    /**
+     * @brief What an enqueue does when the queue is full
+     */
+    typedef enum queue_overflow
+    {
+        QUEUE_OVERFLOW_BLOCK,     /* wait for space (the default) */
+        QUEUE_OVERFLOW_REJECT,    /* drop the new item: enqueue reports QUEUE_FULL */
+        QUEUE_OVERFLOW_EVICT,     /* drop the oldest item to make room */
+        QUEUE_OVERFLOW_OVERWRITE, /* lossy ring, wait-free producers (MPMC only) */
+    } queue_overflow_t;
+
+    /**
+     * @brief Receives an item dropped by the overflow policy so it can be
+     * freed; for a sized queue, item points at the element
+     *
+     * Runs on the producer thread that dropped the item and must not call
+     * back into the queue.
+     */
+    typedef void (*queue_evict_t)(void *item, void *arg);
+
+    /**
+     * @brief Longest queue name, terminating NUL included
+     */
+#define QUEUE_NAME_MAX 32
+
+    /**
+     * @brief A process's registry of named queues, mapped read-only by
+     * queue_registry_open
+     */
+    typedef struct queue_registry *queue_registry_t;
+
+    /**
+     * @brief One named queue as read from a registry by queue_registry_read
+     */
+    typedef struct queue_registry_entry
+    {
+        char name[QUEUE_NAME_MAX]; /* the name given to queue_attr_setname */
+        int capacity;              /* maximum number of items */
+        queue_backend_t backend;   /* the implementation serving the queue */
+        queue_snapshot_t stats;    /* its counters when the entry was read */
+    } queue_registry_entry_t;
+
+    /**
+     * @brief Creation attributes for queue_init_attr
+     *
+     * Modeled on pthread_attr_t: initialize with queue_attr_init, change
+     * fields with the queue_attr_set* functions and pass it to
+     * queue_init_attr, which copies what it needs. One attribute object
+     * may create any number of queues.
+     */
+    typedef struct queue_attr
+    {
+        int capacity;                /* maximum number of items, must be set */
+        queue_backend_t backend;     /* QUEUE_BACKEND_MUTEX by default */
+        queue_parking_t parking;     /* mutex backend only */
+        queue_wait_strategy_t wait;  /* spin/yield before parking */
+        size_t elem_size;            /* inline element size, 0 for pointers */
+        bool pow2;                   /* round capacity up to a power of two */
+        bool lazy;                   /* commit ring pages on demand */
+        bool mirrored;               /* map the ring twice, back to back */
+        queue_placement_t placement; /* huge pages and NUMA policy */
+        queue_overflow_t overflow;   /* what a full queue does with new items */
+        queue_evict_t evict;         /* receives evicted items, or NULL */
+        void *evict_arg;             /* second argument to evict */
+        size_t max_bytes;            /* byte budget for enqueue_bytes, 0 for none */
+        bool stats;                  /* keep counters for queue_stats_snapshot */
+        char name[QUEUE_NAME_MAX];   /* publish the counters under this name, or "" */
+        int segment_cache;           /* unbounded backend: drained segments kept for reuse */
+    } queue_attr_t;
+
+    /**
+     * @brief Initialize queue attributes to the defaults
+     *
+     * The defaults describe the queue_init queue: mutex backend, condition
+     * variables, no spinning, pointer items, default placement. The
+     * capacity has no default and must be set.
+     *
+     * @param attr the attributes
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_init(queue_attr_t *attr);
+
+    /**
+     * @brief Destroy queue attributes; queues created from them are unaffected
+     *
+     * @param attr the attributes
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_destroy(queue_attr_t *attr);
+
+    /**
+     * @brief Set the maximum number of items
+     *
+     * @return 0, or EINVAL if capacity is not positive
+     */
+    int queue_attr_setcapacity(queue_attr_t *attr, int capacity);
+
+    /**
+     * @brief Select the backend (see queue_init_spsc and queue_init_mpmc)
+     *
+     * @return 0, or EINVAL for an unknown backend
+     */
+    int queue_attr_setbackend(queue_attr_t *attr, queue_backend_t backend);
+
+    /**
+     * @brief Select how the mutex backend parks (see queue_init_futex)
+     *
+     * @return 0, or EINVAL for an unknown parking mode
+     */
+    int queue_attr_setparking(queue_attr_t *attr, queue_parking_t parking);
+
+    /**
+     * @brief Set the wait strategy (see queue_set_wait_strategy)
+     *
+     * @param strategy the spin and yield budgets, or NULL to park at once
+     * @return 0, or EINVAL for a negative budget
+     */
+    int queue_attr_setwaitstrategy(queue_attr_t *attr, const queue_wait_strategy_t *strategy);
+
+    /**
+     * @brief Store elements of elem_size bytes inline (see queue_init_sized)
+     *
+     * @param elem_size bytes per element, or 0 to queue pointers
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_setelemsize(queue_attr_t *attr, size_t elem_size);
+
+    /**
+     * @brief Round the capacity up to a power of two at creation
+     *
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_setpow2(queue_attr_t *attr, bool pow2);
+
+    /**
+     * @brief Commit ring pages on demand (see queue_init_lazy)
+     *
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_setlazy(queue_attr_t *attr, bool lazy);
+
+    /**
+     * @brief Mirror the ring when its size allows (see queue_set_mirrored)
+     *
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_setmirrored(queue_attr_t *attr, bool mirrored);
+
+    /**
+     * @brief Set huge page and NUMA placement (see queue_init_placed)
+     *
+     * @param placement where the ring should live, or NULL for the default
+     * @return 0, or EINVAL for an unknown policy or a negative bind node
+     */
+    int queue_attr_setplacement(queue_attr_t *attr, const queue_placement_t *placement);
+
+    /**
+     * @brief Set what enqueue does when the queue is full
+     *
+     * QUEUE_OVERFLOW_REJECT refuses the new item: enqueue_until and
+     * try_enqueue report QUEUE_FULL and enqueue_batch stops early. It
+     * never waits, not even for a pending queue_reserve.
+     * QUEUE_OVERFLOW_EVICT drops the oldest queued item instead (not on
+     * SPSC queues, whose producer cannot touch the head). With
+     * QUEUE_OVERFLOW_OVERWRITE an MPMC queue becomes a lossy ring whose
+     * producers never wait for anything: each claims the next position
+     * and swaps its item in, evicting whatever the consumers have not
+     * taken yet a lap later. queue_destroy also evicts the items a lossy
+     * ring still holds. Compact queues only block.
+     *
+     * @param policy the overflow policy
+     * @param evict receives every evicted item (EVICT, OVERWRITE), or NULL
+     * @param arg second argument to evict
+     * @return 0, or EINVAL for an unknown policy
+     */
+    int queue_attr_setoverflow(queue_attr_t *attr, queue_overflow_t policy, queue_evict_t evict,
+                               void *arg);
+
+    /**
+     * @brief Bound the queue by the bytes of its items as well as by count
+     *
+     * Items enqueued with enqueue_bytes carry their size, and a producer
+     * whose item would take the queue past max_bytes is treated like one
+     * facing a full queue: it blocks, or the overflow policy rejects it or
+     * evicts old items until it fits. An item bigger than the whole budget
+     * is admitted once the queue is empty. The capacity still bounds the
+     * number of items. Mutex backend pointer queues only; they do not
+     * support spans or mirroring.
+     *
+     * @param max_bytes the byte budget, or 0 for none
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_setmaxbytes(queue_attr_t *attr, size_t max_bytes);
+
+    /**
+     * @brief Keep operation counters for queue_stats_snapshot
+     *
+     * The queue counts items in and out, waits on a full or empty queue
+     * and the time spent in them, its peak occupancy and how long every
+     * item stayed queued, stamping each slot as it is filled. Costs two
+     * clock reads per item; queues without stats only test a pointer they
+     * load anyway. Not for compact queues or lossy
+     * (QUEUE_OVERFLOW_OVERWRITE) rings.
+     *
+     * @return 0, or EINVAL if attr is NULL
+     */
+    int queue_attr_setstats(queue_attr_t *attr, bool stats);
+
+    /**
+     * @brief Publish the queue's stats in the process's shared registry
+     *
+     * Implies queue_attr_setstats. The counters of a named queue live in
+     * a POSIX shared memory segment, /queuetop.<pid>, created on the
+     * first named queue and removed when the process exits, so tools such
+     * as queuetop can watch them with queue_registry_open while the
+     * process runs. Publishing adds nothing to the stats mode's cost:
+     * producers and consumers update the same relaxed counters, just in
+     * shared memory. If the registry is full or shared memory is not
+     * available, the queue keeps its stats to itself. Names need not be
+     * unique.
+     *
+     * @param name the name, or NULL or "" to not publish
+     * @return 0, or EINVAL if attr is NULL or name does not fit in
+     *         QUEUE_NAME_MAX
+     */
+    int queue_attr_setname(queue_attr_t *attr, const char *name);
+
+    /**
+     * @brief Set how many drained segments an unbounded queue keeps
+     *
+     * A segment whose items have all been dequeued goes on a free list
+     * for the next producer that runs out of room instead of back to
+     * free(), as long as fewer than segments are cached; 4 by default.
+     * 0 frees every drained segment at once; a queue that swings between
+     * empty and deep may want more to avoid malloc on every swing. Only
+     * the unbounded backend uses it.
+     *
+     * @param segments the most drained segments to keep
+     * @return 0, or EINVAL if attr is NULL or segments is negative
+     */
+    int queue_attr_setsegmentcache(queue_attr_t *attr, int segments);
+
+    /**
+     * @brief Initialize a new queue from creation attributes
+     *
+     * Every option is resolved here: the queue picks the functions that
+     * serve it once, so enqueue, dequeue, the span calls, is_empty and
+     * queue_stats never test the options again.
+     *
+     * Combinations that cannot work return NULL: no capacity (except on
+     * an unbounded queue, which ignores it), inline elements, lazy rings
+     * or futex parking on a lock-free backend, a mirrored ring that is
+     * also lazy, placed or MPMC, mirroring, placement, a wait strategy or
+     * an overflow policy on a compact queue, evicting from an SPSC queue,
+     * overwriting on anything but MPMC, a byte budget on anything but a
+     * mutex backend pointer queue that is not mirrored, stats or a name
+     * on a compact queue or a lossy ring, or anything on an unbounded
+     * queue but a wait strategy, futex parking and the segment cache. An
+     * unbounded queue holds at most INT_MAX items. A ring too small to
+     * mirror keeps its normal allocation, as with queue_set_mirrored.
+     *
+     * @param attr the attributes
+     * @return A fully initialized queue, or NULL
+     */
+    queue_t queue_init_attr(const queue_attr_t *attr);
+
     /**
      * @brief Initialize a new queue
      *
+     * Same as queue_init_attr with default attributes and the capacity.
+     *
      * @param capacity the maximum capacity of the queue
      * @return A fully initialized queue
      */
     queue_t queue_init(int capacity);
 
+    /**
+     * @brief Initialize a new single-producer/single-consumer queue
+     *
+     * The queue is backed by a lock-free ring: enqueue and dequeue only
+     * touch the mutex when the ring is full or empty and a thread has to
+     * block. Exactly one thread may call enqueue and exactly one thread may
+     * call dequeue for the lifetime of the queue.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @return A fully initialized queue
+     */
+    queue_t queue_init_spsc(int capacity);
+
+    /**
+     * @brief Initialize a new queue that parks blocked threads on futexes
+     *
+     * Same mutex-protected queue as queue_init, but producers and consumers
+     * that have to wait sleep on futex words rather than pthread condition
+     * variables, and wakers only enter the kernel when somebody is parked.
+     * Linux only.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @return A fully initialized queue
+     */
+    queue_t queue_init_futex(int capacity);
+
+    /**
+     * @brief Initialize a new multi-producer/multi-consumer lock-free queue
+     *
+     * Every slot carries a sequence number; producers and consumers claim
+     * positions with a compare-and-swap and never take a global mutex
+     * unless they have to block on a full or empty queue.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @return A fully initialized queue
+     */
+    queue_t queue_init_mpmc(int capacity);
+
+    /**
+     * @brief Initialize a new compact queue for large numbers of mostly
+     * idle queues
+     *
+     * Blocks like queue_init, but the lock is a single word and blocked
+     * threads park in one process-wide parking lot keyed by address
+     * instead of in per-queue mutexes and condition variables, so a queue
+     * costs a few words plus its slots. Pointer items only; spans,
+     * mirroring, placement and wait strategies are not supported.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @return A fully initialized queue
+     */
+    queue_t queue_init_compact(int capacity);
+
+    /**
+     * @brief Initialize a new unbounded queue, for stages whose producers
+     * must never block
+     *
+     * Items live in a linked list of fixed-size array segments: enqueue
+     * appends a segment when the last one is full instead of waiting, and
+     * never copies queued items. dequeue blocks on an empty queue and
+     * honors shutdown as with queue_init. enqueue reports QUEUE_FULL only
+     * if no memory is left for a new segment. The queue also holds at
+     * most INT_MAX items and reports QUEUE_FULL beyond that. Pointer
+     * items only; spans, mirroring, byte budgets and stats are not
+     * supported.
+     *
+     * @return A fully initialized queue
+     */
+    queue_t queue_init_unbounded(void);
+
+    /**
+     * @brief Initialize a new queue that stores fixed-size elements inline
+     *
+     * Elements are copied into a contiguous slot array by enqueue_copy and
+     * back out by dequeue_copy, so callers need not allocate each item. A
+     * sized queue uses the mutex backend; the pointer calls (enqueue,
+     * dequeue, try_*, *_until, *_batch) treat it as shut down.
+     *
+     * @param capacity the maximum number of elements in the queue
+     * @param elem_size the size of each element in bytes
+     * @return A fully initialized queue, or NULL if elem_size is 0
+     */
+    queue_t queue_init_sized(int capacity, size_t elem_size);
+
+    /**
+     * @brief Initialize a new queue whose ring commits memory on demand
+     *
+     * The ring is reserved as address space and its pages are committed
+     * on first touch as the tail advances, so a queue sized for rare
+     * bursts only costs memory for the items it actually holds. Whenever
+     * the queue drains after a large enough burst, the pages behind head
+     * are returned to the kernel. Uses the mutex backend.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @return A fully initialized queue
+     */
+    queue_t queue_init_lazy(int capacity);
+
+    /**
+     * @brief Initialize a new queue with huge page and NUMA placement
+     *
+     * The ring gets a mapping of its own. With huge_pages it is aligned to
+     * 2 MiB and advised MADV_HUGEPAGE (a hint the kernel may ignore). A
+     * NUMA policy is applied with mbind before any page is touched, so
+     * every slot lands on the requested node(s). Uses the mutex backend.
+     *
+     * @param capacity the maximum capacity of the queue
+     * @param placement where the ring should live, or NULL for the default
+     * @return A fully initialized queue, or NULL if the NUMA policy failed
+     */
+    queue_t queue_init_placed(int capacity, const queue_placement_t *placement);
+
+    /**
+     * @brief Bytes of memory queue_init_in_place needs
+     *
+     * @param capacity the maximum capacity of the queue
+     * @return the size in bytes, or 0 if capacity is not positive or too
+     *         large
+     */
+    size_t queue_required_size(int capacity);
+
+    /**
+     * @brief Initialize a new queue inside caller-provided memory
+     *
+     * The queue is the one queue_init creates, built in mem instead of a
+     * heap allocation, so arenas and stack frames can hold short-lived
+     * queues. queue_destroy releases the queue's resources but leaves mem
+     * to the caller, who must keep it valid until then.
+     *
+     * @param mem the memory, any alignment
+     * @param size bytes at mem, at least queue_required_size(capacity)
+     * @param capacity the maximum capacity of the queue
+     * @return A fully initialized queue inside mem, or NULL if mem is NULL
+     *         or smaller than queue_required_size(capacity)
+     */
+    queue_t queue_init_in_place(void *mem, size_t size, int capacity);
+
+    /**
+     * @brief Move the ring of a new queue into a mirrored mapping
+     *
+     * The same memfd-backed pages are mapped twice, back to back, so any
+     * run of up to capacity slots is contiguous: batch copies use a single
+     * memcpy and spans never split. Only rings whose size in bytes is a
+     * multiple of the page size can be mirrored (e.g. a capacity of 512
+     * pointers with 4 KiB pages); others keep the normal allocation. Must
+     * be called before the queue is shared or holds any item.
+     *
+     * @param q the queue (mutex or SPSC backend, pointer or sized, without
+     *        a byte budget)
+     * @return true if the ring is now mirrored
+     */
+    bool queue_set_mirrored(queue_t q);
+
+    /**
+     * @brief Round a capacity up to the next power of two
+     *
+     * Lock-free queues whose capacity is a power of two index their
+     * ring with a mask instead of a division; pass the result to any
+     * queue_init_* function, or set pow2 in queue_attr_t, to opt in.
+     *
+     * @param capacity the requested capacity
+     * @return the rounded capacity, or 0 if capacity is not positive or
+     *         too large
+     */
+    int queue_pow2_capacity(int capacity);
+
+    /**
+     * @brief Set how threads wait before parking on a full or empty queue
+     *
+     * Must be called before the queue is shared with other threads.
+     *
+     * @param q the queue
+     * @param strategy the spin and yield budgets, or NULL to park at once
+     */
+    void queue_set_wait_strategy(queue_t q, const queue_wait_strategy_t *strategy);
+
     /**
      * @brief Frees all memory and related data signals all waiting threads.
      *
@@ -43,6 +620,333 @@ extern "C"
      */
     void *dequeue(queue_t q);
 
+    /**
+     * @brief Copy an element into the back of a sized queue
+     *
+     * Blocks while the queue is full.
+     *
+     * @param q a queue created with queue_init_sized
+     * @param elem the element to copy, elem_size bytes
+     * @return QUEUE_OK, QUEUE_FULL under QUEUE_OVERFLOW_REJECT, or
+     *         QUEUE_SHUTDOWN if shut down or q is not sized
+     */
+    queue_status_t enqueue_copy(queue_t q, const void *elem);
+
+    /**
+     * @brief Copy the first element of a sized queue out and remove it
+     *
+     * Blocks while the queue is empty.
+     *
+     * @param q a queue created with queue_init_sized
+     * @param out where to copy the element, elem_size bytes
+     * @return QUEUE_OK, or QUEUE_SHUTDOWN once shut down and drained or if
+     *         q is not sized
+     */
+    queue_status_t dequeue_copy(queue_t q, void *out);
+
+    /**
+     * @brief Adds an element to the back of the queue without blocking
+     *
+     * @param q the queue
+     * @param data the data to add
+     * @return QUEUE_OK, QUEUE_FULL, QUEUE_SHUTDOWN or QUEUE_BUSY
+     */
+    queue_status_t try_enqueue(queue_t q, void *data);
+
+    /**
+     * @brief Removes the first element in the queue without blocking
+     *
+     * @param q the queue
+     * @param out where to store the element on QUEUE_OK
+     * @return QUEUE_OK, QUEUE_EMPTY, QUEUE_SHUTDOWN or QUEUE_BUSY
+     */
+    queue_status_t try_dequeue(queue_t q, void **out);
+
+    /**
+     * @brief Adds an element to the back of the queue, blocking no later
+     * than deadline
+     *
+     * @param q the queue
+     * @param data the data to add
+     * @param deadline absolute CLOCK_MONOTONIC time, or NULL to wait forever
+     * @return QUEUE_OK, QUEUE_SHUTDOWN or QUEUE_TIMEOUT, or QUEUE_FULL
+     *         under QUEUE_OVERFLOW_REJECT
+     */
+    queue_status_t enqueue_until(queue_t q, void *data, const struct timespec *deadline);
+
+    /**
+     * @brief Removes the first element in the queue, blocking no later
+     * than deadline
+     *
+     * @param q the queue
+     * @param out where to store the element on QUEUE_OK
+     * @param deadline absolute CLOCK_MONOTONIC time, or NULL to wait forever
+     * @return QUEUE_OK, QUEUE_SHUTDOWN (shutdown and drained) or QUEUE_TIMEOUT
+     */
+    queue_status_t dequeue_until(queue_t q, void **out, const struct timespec *deadline);
+
+    /**
+     * @brief Adds an item of the given size to the back of the queue,
+     * blocking no later than deadline while it would exceed the byte
+     * budget (see queue_attr_setmaxbytes)
+     *
+     * Items added by the other enqueue calls count as 0 bytes. On a queue
+     * without a byte budget the size is ignored.
+     *
+     * @param q the queue
+     * @param data the data to add
+     * @param bytes the memory the item accounts for
+     * @param deadline absolute CLOCK_MONOTONIC time, or NULL to wait forever
+     * @return as enqueue_until
+     */
+    queue_status_t enqueue_bytes(queue_t q, void *data, size_t bytes, const struct timespec *deadline);
+
+    /**
+     * @brief Like dequeue_until, also reporting the size the item was
+     * enqueued with (0 if it had none)
+     *
+     * @param q the queue
+     * @param out where to store the element on QUEUE_OK
+     * @param bytes where to store its size on QUEUE_OK, or NULL
+     * @param deadline absolute CLOCK_MONOTONIC time, or NULL to wait forever
+     * @return as dequeue_until
+     */
+    queue_status_t dequeue_bytes(queue_t q, void **out, size_t *bytes, const struct timespec *deadline);
+
+    /**
+     * @brief Like enqueue_until with a deadline timeout_ms from now
+     */
+    queue_status_t enqueue_timeout(queue_t q, void *data, long timeout_ms);
+
+    /**
+     * @brief Like dequeue_until with a deadline timeout_ms from now
+     */
+    queue_status_t dequeue_timeout(queue_t q, void **out, long timeout_ms);
+
+    /**
+     * @brief Adds n elements to the back of the queue
+     *
+     * Moves as many items as fit under a single lock acquisition (or a
+     * single index update on the SPSC ring) and blocks while the queue is
+     * full until every item is enqueued. MPMC, lossy and byte-bounded
+     * queues enqueue the items one at a time instead, so other producers'
+     * items may land in between.
+     *
+     * @param q the queue
+     * @param items the items to add, none of which may be NULL
+     * @param n the number of items
+     * @return the number of items enqueued, fewer than n only after
+     *         shutdown or when QUEUE_OVERFLOW_REJECT refused the rest
+     */
+    int enqueue_batch(queue_t q, void **items, int n);
+
+    /**
+     * @brief Removes up to max elements from the front of the queue
+     *
+     * Blocks until at least min items are available or the queue is
+     * shutdown, then takes as many items as possible, up to max. MPMC,
+     * lossy and byte-bounded queues dequeue them one at a time, so other
+     * consumers may take items in between.
+     *
+     * @param q the queue
+     * @param out where to store the items
+     * @param max the maximum number of items to take
+     * @param min the number of items to wait for, 0 to never block
+     * @return the number of items dequeued, 0 once shutdown and drained
+     */
+    int dequeue_batch(queue_t q, void **out, int max, int min);
+
+    /**
+     * @brief Reserve n free slots at the tail to write items in place
+     *
+     * Blocks until n slots are free. Only one reservation is pending at a
+     * time: on the mutex backend other producers wait until it is
+     * committed, while the single SPSC producer gets QUEUE_BUSY if it
+     * reserves again before committing. A QUEUE_OVERFLOW_REJECT queue
+     * never waits and reports QUEUE_FULL instead. Supported by the mutex
+     * and SPSC backends, except for byte-bounded queues.
+     *
+     * @param q the queue
+     * @param n number of slots, clamped to the capacity
+     * @param span where to store the reserved slots
+     * @return QUEUE_OK, QUEUE_BUSY (SPSC only) if a reservation is already
+     *         pending, QUEUE_FULL (REJECT only), or QUEUE_SHUTDOWN if the
+     *         queue is shut down or does not support reservations
+     */
+    queue_status_t queue_reserve(queue_t q, int n, queue_span_t *span);
+
+    /**
+     * @brief Publish the first n slots of the pending reservation
+     *
+     * The rest of the reservation is given back. A reservation interrupted
+     * by queue_shutdown is discarded.
+     *
+     * @param q the queue
+     * @param n number of slots written, clamped to the reservation
+     * @return QUEUE_OK, or QUEUE_SHUTDOWN if the items were discarded
+     */
+    queue_status_t queue_commit(queue_t q, int n);
+
+    /**
+     * @brief Lend out up to max items at the head to read them in place
+     *
+     * Blocks until at least one item is available. The items stay queued
+     * until queue_release: on the mutex backend other consumers wait
+     * meanwhile, while the single SPSC consumer gets QUEUE_BUSY if it
+     * peeks again before releasing.
+     *
+     * @param q the queue
+     * @param max maximum number of items
+     * @param span where to store the items
+     * @return QUEUE_OK, QUEUE_BUSY (SPSC only) if a span is already lent
+     *         out, or QUEUE_SHUTDOWN once shut down and drained or if the
+     *         queue does not support spans
+     */
+    queue_status_t queue_peek_span(queue_t q, int max, queue_span_t *span);
+
+    /**
+     * @brief Remove the first n items of the pending peeked span
+     *
+     * @param q the queue
+     * @param n number of items consumed, clamped to the span
+     */
+    void queue_release(queue_t q, int n);
+
+    /**
+     * @brief Take a snapshot of the queue's occupancy and memory use
+     *
+     * @param q the queue
+     * @param stats where to store the snapshot
+     */
+    void queue_stats(queue_t q, queue_stats_t *stats);
+
+    /**
+     * @brief Read the counters of a queue created with queue_attr_setstats
+     *
+     * Takes no lock and never blocks the queue's producers or consumers,
+     * so it can be polled from a monitoring thread at any rate.
+     *
+     * @param q the queue
+     * @param snap where to store the counters; zeroed if q keeps none
+     * @return true, or false if q was created without stats
+     */
+    bool queue_stats_snapshot(queue_t q, queue_snapshot_t *snap);
+
+    /**
+     * @brief Lower bound, in nanoseconds, of a time-in-queue bucket
+     *
+     * @param bucket index into queue_snapshot_t.latency
+     * @return The shortest time counted in bucket
+     */
+    unsigned long long queue_latency_bucket_ns(int bucket);
+
+    /**
+     * @brief Time in queue below which the given percentage of the
+     * dequeued items in a snapshot stayed, to the resolution of its bucket
+     *
+     * @param snap the snapshot
+     * @param percent between 0 and 100, e.g. 99 for the p99
+     * @return The upper bound of the bucket holding that percentile, in
+     *         nanoseconds, or 0 if no item has been dequeued
+     */
+    unsigned long long queue_latency_percentile(const queue_snapshot_t *snap, double percent);
+
+    /**
+     * @brief Call sites of a queue's lock, as booked by the lock profiler
+     */
+    typedef enum queue_lock_site
+    {
+        QUEUE_LOCK_ENQUEUE,     /* enqueue paths, including spans and batches */
+        QUEUE_LOCK_DEQUEUE,     /* dequeue paths */
+        QUEUE_LOCK_IS_EMPTY,    /* is_empty */
+        QUEUE_LOCK_IS_SHUTDOWN, /* is_shutdown */
+        QUEUE_LOCK_SHUTDOWN,    /* queue_shutdown */
+        QUEUE_LOCK_SITES
+    } queue_lock_site_t;
+
+    /**
+     * @brief What the lock profiler measured at one call site, filled in
+     * by queue_lock_profile. Times are totals and maxima in nanoseconds.
+     */
+    typedef struct queue_lock_stats
+    {
+        unsigned long long acquires;         /* times the site took the lock */
+        unsigned long long contended;        /* of those, how many found it held */
+        unsigned long long trylock_failures; /* non-blocking calls that gave up */
+        unsigned long long acquire_ns;       /* asking for the lock to getting it */
+        unsigned long long acquire_max_ns;
+        unsigned long long hold_ns;          /* getting the lock to releasing it */
+        unsigned long long hold_max_ns;
+        unsigned long long wakeups;          /* waits ended by a wake-up */
+        unsigned long long wake_ns;          /* wake-up to running with the lock */
+        unsigned long long wake_max_ns;
+    } queue_lock_stats_t;
+
+    /**
+     * @brief Copy the lock profile of a queue, one entry per call site
+     *
+     * Taken under the queue's lock, so it is consistent and may be read
+     * while the queue is in use.
+     *
+     * @param q the queue
+     * @param sites where to store the profile, indexed by queue_lock_site_t
+     * @return true if filled in, false (and sites zeroed) if the library
+     *         was built without -DQUEUE_LOCK_PROFILE or q is compact
+     */
+    bool queue_lock_profile(queue_t q, queue_lock_stats_t sites[QUEUE_LOCK_SITES]);
+
+    /**
+     * @brief Print the lock profile of a queue to stderr
+     *
+     * In a build with -DQUEUE_LOCK_PROFILE (make lockprof) every critical
+     * section on the queue's lock is timed and booked under its call site
+     * (enqueue, dequeue, is_empty, is_shutdown or shutdown), and
+     * queue_destroy prints the profile on its way out. Otherwise this does
+     * nothing and the lock is not instrumented at all.
+     *
+     * @param q the queue
+     */
+    void queue_lock_profile_dump(queue_t q);
+
+    /**
+     * @brief Find the processes that publish named queues
+     *
+     * @param pids where to store the process IDs
+     * @param max room in pids
+     * @return The number of processes found, at most max
+     */
+    int queue_registry_list(int *pids, int max);
+
+    /**
+     * @brief Map the registry of a process read-only
+     *
+     * Reading never writes to the segment or blocks the process's queues.
+     *
+     * @param pid the process, e.g. getpid() for this one
+     * @return The registry, or NULL if the process publishes no queues
+     */
+    queue_registry_t queue_registry_open(int pid);
+
+    /**
+     * @brief Read the named queues currently published in a registry
+     *
+     * Queues created or destroyed while the registry is read may be
+     * skipped; every entry returned is consistent.
+     *
+     * @param reg the registry
+     * @param entries where to store the queues
+     * @param max room in entries
+     * @return The number of entries stored
+     */
+    int queue_registry_read(queue_registry_t reg, queue_registry_entry_t *entries, int max);
+
+    /**
+     * @brief Unmap a registry opened with queue_registry_open
+     *
+     * @param reg the registry, or NULL
+     */
+    void queue_registry_close(queue_registry_t reg);
+
     /**
      * @brief Set the shutdown flag in the queue so all threads can
      * complete and exit properly
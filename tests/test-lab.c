@@ -1,3 +1,9 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "harness/unity.h"
 #include "../src/lab.h"
 
@@ -218,6 +224,1364 @@ void test_stress_multithreaded(void) {
     // TODO
 }
 
+/**
+ * @brief The SPSC ring keeps FIFO order across wraparound and drains
+ *        remaining items after shutdown.
+ */
+void test_spsc_fifo_and_shutdown(void) {
+    queue_t q = queue_init_spsc(2);
+    TEST_ASSERT_NOT_NULL(q);
+    int a = 1, b = 2, c = 3;
+    enqueue(q, &a);
+    enqueue(q, &b);
+    TEST_ASSERT_EQUAL_PTR(&a, dequeue(q));
+    enqueue(q, &c); // wraps around to slot 0
+    TEST_ASSERT_EQUAL_PTR(&b, dequeue(q));
+    queue_shutdown(q);
+    enqueue(q, &a); // dropped after shutdown
+    TEST_ASSERT_EQUAL_PTR(&c, dequeue(q));
+    TEST_ASSERT_NULL(dequeue(q));
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+}
+
+#define SPSC_ITEMS 100000
+
+static void *spsc_producer(void *arg) {
+    static int items[SPSC_ITEMS];
+    queue_t q = arg;
+    for (int i = 0; i < SPSC_ITEMS; i++) {
+        items[i] = i;
+        enqueue(q, &items[i]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief One producer thread and one consumer thread hand items through a
+ *        tiny SPSC ring so both the full and empty blocking paths are hit.
+ */
+void test_spsc_threaded_order(void) {
+    queue_t q = queue_init_spsc(4);
+    pthread_t producer;
+    pthread_create(&producer, NULL, spsc_producer, q);
+    for (int i = 0; i < SPSC_ITEMS; i++) {
+        int *item = dequeue(q);
+        TEST_ASSERT_NOT_NULL(item);
+        TEST_ASSERT_EQUAL_INT(i, *item);
+    }
+    pthread_join(producer, NULL);
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+}
+
+/**
+ * @brief The MPMC ring keeps FIFO order across laps and drains remaining
+ *        items after shutdown.
+ */
+void test_mpmc_fifo_and_shutdown(void) {
+    queue_t q = queue_init_mpmc(2);
+    TEST_ASSERT_NOT_NULL(q);
+    int a = 1, b = 2, c = 3;
+    enqueue(q, &a);
+    enqueue(q, &b);
+    TEST_ASSERT_EQUAL_PTR(&a, dequeue(q));
+    enqueue(q, &c); // second lap of slot 0
+    TEST_ASSERT_EQUAL_PTR(&b, dequeue(q));
+    queue_shutdown(q);
+    enqueue(q, &a); // dropped after shutdown
+    TEST_ASSERT_EQUAL_PTR(&c, dequeue(q));
+    TEST_ASSERT_NULL(dequeue(q));
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+}
+
+#define MPMC_THREADS 4
+#define MPMC_ITEMS 20000
+
+static int mpmc_items[MPMC_THREADS][MPMC_ITEMS];
+static queue_t mpmc_queue;
+
+static void *mpmc_producer(void *arg) {
+    int *items = arg;
+    for (int i = 0; i < MPMC_ITEMS; i++) {
+        items[i] = i;
+        enqueue(mpmc_queue, &items[i]);
+    }
+    return NULL;
+}
+
+static void *mpmc_consumer(void *arg) {
+    long *sum = arg;
+    int *item;
+    while ((item = dequeue(mpmc_queue)) != NULL) {
+        *sum += *item;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Several producers and consumers share a small MPMC ring; every
+ *        item must come out exactly once before the consumers see NULL.
+ */
+void test_mpmc_threaded_sum(void) {
+    pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+    long sums[MPMC_THREADS] = {0};
+    mpmc_queue = queue_init_mpmc(8);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+        pthread_create(&producers[i], NULL, mpmc_producer, mpmc_items[i]);
+    }
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    queue_shutdown(mpmc_queue);
+    long total = 0;
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(consumers[i], NULL);
+        total += sums[i];
+    }
+    long expected = (long)MPMC_THREADS * MPMC_ITEMS * (MPMC_ITEMS - 1) / 2;
+    TEST_ASSERT_EQUAL_INT64(expected, total);
+    TEST_ASSERT_TRUE(is_empty(mpmc_queue));
+    queue_destroy(mpmc_queue);
+}
+
+/**
+ * @brief Batch operations copy runs across the wrap point in FIFO order on
+ *        every backend.
+ */
+void test_batch_wraparound(void) {
+    queue_t queues[] = {queue_init(5), queue_init_spsc(5), queue_init_mpmc(5),
+                        queue_init_compact(5)};
+    int items[8];
+    void *in[8], *out[8];
+    for (int i = 0; i < 8; i++) {
+        items[i] = i;
+        in[i] = &items[i];
+    }
+    for (int b = 0; b < 4; b++) {
+        queue_t q = queues[b];
+        TEST_ASSERT_EQUAL_INT(3, enqueue_batch(q, in, 3));
+        TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, out, 2, 1));
+        TEST_ASSERT_EQUAL_PTR(in[0], out[0]);
+        TEST_ASSERT_EQUAL_PTR(in[1], out[1]);
+        // Tail is at slot 3: the next four items wrap to slots 0 and 1.
+        TEST_ASSERT_EQUAL_INT(4, enqueue_batch(q, in + 3, 4));
+        TEST_ASSERT_EQUAL_INT(5, dequeue_batch(q, out, 8, 5));
+        for (int i = 0; i < 5; i++) {
+            TEST_ASSERT_EQUAL_PTR(in[i + 2], out[i]);
+        }
+        TEST_ASSERT_TRUE(is_empty(q));
+        queue_destroy(q);
+    }
+}
+
+/**
+ * @brief dequeue_batch with min 0 never blocks, and after shutdown it
+ *        returns whatever is left even if that is less than min.
+ */
+void test_batch_min_and_shutdown(void) {
+    queue_t q = queue_init(4);
+    int a = 1, b = 2;
+    void *in[] = {&a, &b};
+    void *out[4];
+    TEST_ASSERT_EQUAL_INT(0, dequeue_batch(q, out, 4, 0));
+    enqueue_batch(q, in, 2);
+    queue_shutdown(q);
+    TEST_ASSERT_EQUAL_INT(0, enqueue_batch(q, in, 2));
+    TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, out, 4, 4));
+    TEST_ASSERT_EQUAL_INT(0, dequeue_batch(q, out, 4, 1));
+    queue_destroy(q);
+}
+
+/**
+ * @brief try_enqueue/try_dequeue report full, empty and shutdown instead of
+ *        blocking, on every backend.
+ */
+void test_try_status_codes(void) {
+    queue_t queues[] = {queue_init(2), queue_init_spsc(2), queue_init_mpmc(2),
+                        queue_init_compact(2)};
+    int a = 1, b = 2, c = 3;
+    for (int i = 0; i < 4; i++) {
+        queue_t q = queues[i];
+        void *out = NULL;
+        TEST_ASSERT_EQUAL_INT(QUEUE_EMPTY, try_dequeue(q, &out));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &a));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &b));
+        TEST_ASSERT_EQUAL_INT(QUEUE_FULL, try_enqueue(q, &c));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+        TEST_ASSERT_EQUAL_PTR(&a, out);
+        queue_shutdown(q);
+        TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, try_enqueue(q, &c));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+        TEST_ASSERT_EQUAL_PTR(&b, out);
+        TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, try_dequeue(q, &out));
+        queue_destroy(q);
+    }
+}
+
+/**
+ * @brief Timed operations on a full or empty queue give up with
+ *        QUEUE_TIMEOUT once their deadline passes, on every backend.
+ */
+void test_timed_operations_time_out(void) {
+    queue_t queues[] = {queue_init(1), queue_init_spsc(1), queue_init_mpmc(1),
+                        queue_init_compact(1)};
+    int a = 1, b = 2;
+    for (int i = 0; i < 4; i++) {
+        queue_t q = queues[i];
+        void *out = NULL;
+        TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, dequeue_timeout(q, &out, 5));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_timeout(q, &a, 5));
+        struct timespec past = {0, 0};
+        TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, enqueue_until(q, &b, &past));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_until(q, &out, &past));
+        TEST_ASSERT_EQUAL_PTR(&a, out);
+        queue_destroy(q);
+    }
+}
+
+static void *shutdown_after_delay(void *arg) {
+    struct timespec delay = {0, 10 * 1000000L};
+    nanosleep(&delay, NULL);
+    queue_shutdown(arg);
+    return NULL;
+}
+
+/**
+ * @brief A timed wait that is interrupted by queue_shutdown reports
+ *        QUEUE_SHUTDOWN rather than QUEUE_TIMEOUT.
+ */
+void test_timed_wait_interrupted_by_shutdown(void) {
+    queue_t q = queue_init(1);
+    pthread_t t;
+    void *out = NULL;
+    pthread_create(&t, NULL, shutdown_after_delay, q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, dequeue_timeout(q, &out, 10000));
+    pthread_join(t, NULL);
+    queue_destroy(q);
+}
+
+static void *dequeue_once(void *arg) {
+    return dequeue(arg);
+}
+
+/**
+ * @brief A burst of single enqueues must wake one sleeping consumer per
+ *        item, not just the first one to see the queue become non-empty.
+ */
+void test_burst_wakes_every_sleeping_consumer(void) {
+    queue_t q = queue_init(8);
+    pthread_t consumers[3];
+    int items[3] = {1, 2, 3};
+    for (int i = 0; i < 3; i++) {
+        pthread_create(&consumers[i], NULL, dequeue_once, q);
+    }
+    // Give the consumers time to park on the empty queue.
+    struct timespec delay = {0, 20 * 1000000L};
+    nanosleep(&delay, NULL);
+    for (int i = 0; i < 3; i++) {
+        enqueue(q, &items[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        void *got = NULL;
+        pthread_join(consumers[i], &got);
+        TEST_ASSERT_NOT_NULL(got);
+    }
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+}
+
+/**
+ * @brief A futex-parked queue with a tiny capacity passes every item from
+ *        several producers to several consumers and shuts down cleanly.
+ */
+void test_futex_parking_threaded_sum(void) {
+    pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+    long sums[MPMC_THREADS] = {0};
+    mpmc_queue = queue_init_futex(2);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+        pthread_create(&producers[i], NULL, mpmc_producer, mpmc_items[i]);
+    }
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    queue_shutdown(mpmc_queue);
+    long total = 0;
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(consumers[i], NULL);
+        total += sums[i];
+    }
+    TEST_ASSERT_EQUAL_INT64((long)MPMC_THREADS * MPMC_ITEMS * (MPMC_ITEMS - 1) / 2, total);
+    queue_destroy(mpmc_queue);
+}
+
+/**
+ * @brief Futex parking honors deadlines and is woken by queue_shutdown.
+ */
+void test_futex_parking_timeout_and_shutdown(void) {
+    queue_t q = queue_init_futex(1);
+    void *out = NULL;
+    int a = 1;
+    TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, dequeue_timeout(q, &out, 5));
+    enqueue(q, &a);
+    TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, enqueue_timeout(q, &a, 5));
+    TEST_ASSERT_EQUAL_PTR(&a, dequeue(q));
+    pthread_t t;
+    pthread_create(&t, NULL, shutdown_after_delay, q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, dequeue_timeout(q, &out, 10000));
+    pthread_join(t, NULL);
+    queue_destroy(q);
+}
+
+
+/**
+ * @brief With an adaptive spin-then-yield wait strategy every backend still
+ *        passes all items through, and a spinning waiter still times out or
+ *        sees shutdown.
+ */
+void test_adaptive_wait_strategy(void) {
+    queue_wait_strategy_t strategy = {200, 2, true};
+    queue_t (*inits[])(int) = {queue_init, queue_init_futex, queue_init_mpmc};
+    for (size_t k = 0; k < sizeof(inits) / sizeof(inits[0]); k++) {
+        pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+        long sums[MPMC_THREADS] = {0};
+        mpmc_queue = inits[k](4);
+        queue_set_wait_strategy(mpmc_queue, &strategy);
+        for (int i = 0; i < MPMC_THREADS; i++) {
+            pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+            pthread_create(&producers[i], NULL, mpmc_producer, mpmc_items[i]);
+        }
+        for (int i = 0; i < MPMC_THREADS; i++) {
+            pthread_join(producers[i], NULL);
+        }
+        queue_shutdown(mpmc_queue);
+        long total = 0;
+        for (int i = 0; i < MPMC_THREADS; i++) {
+            pthread_join(consumers[i], NULL);
+            total += sums[i];
+        }
+        TEST_ASSERT_EQUAL_INT64((long)MPMC_THREADS * MPMC_ITEMS * (MPMC_ITEMS - 1) / 2, total);
+        queue_destroy(mpmc_queue);
+    }
+
+    queue_t q = queue_init_spsc(1);
+    queue_set_wait_strategy(q, &strategy);
+    void *out = NULL;
+    TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, dequeue_timeout(q, &out, 5));
+    pthread_t t;
+    pthread_create(&t, NULL, shutdown_after_delay, q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, dequeue_timeout(q, &out, 10000));
+    pthread_join(t, NULL);
+    queue_destroy(q);
+}
+
+/**
+ * @brief Capacities round up to powers of two, and mask-indexed queues of
+ *        every backend keep FIFO order across many wraps.
+ */
+void test_pow2_capacity_wraparound(void) {
+    TEST_ASSERT_EQUAL_INT(1, queue_pow2_capacity(1));
+    TEST_ASSERT_EQUAL_INT(8, queue_pow2_capacity(5));
+    TEST_ASSERT_EQUAL_INT(8, queue_pow2_capacity(8));
+    TEST_ASSERT_EQUAL_INT(0, queue_pow2_capacity(0));
+    TEST_ASSERT_EQUAL_INT(0, queue_pow2_capacity(INT_MAX));
+    queue_t (*inits[])(int) = {queue_init, queue_init_spsc, queue_init_mpmc};
+    int items[20];
+    for (size_t k = 0; k < sizeof(inits) / sizeof(inits[0]); k++) {
+        queue_t q = inits[k](queue_pow2_capacity(3));
+        for (int i = 0; i < 20; i++) {
+            items[i] = i;
+            enqueue(q, &items[i]);
+            if (i >= 2) {
+                TEST_ASSERT_EQUAL_PTR(&items[i - 2], dequeue(q));
+            }
+        }
+        // Two items are still queued; the rounded capacity of 4 fits two more.
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[0]));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[1]));
+        TEST_ASSERT_EQUAL_INT(QUEUE_FULL, try_enqueue(q, &items[2]));
+        queue_destroy(q);
+    }
+}
+
+/**
+ * @brief A sized queue copies whole elements in and out across the wrap
+ *        point, rejects the pointer calls, and drains after shutdown.
+ */
+void test_sized_queue_copies_elements(void) {
+    struct rec { int id; char tag[13]; } in, out;
+    TEST_ASSERT_NULL(queue_init_sized(4, 0));
+    queue_t q = queue_init_sized(3, sizeof(struct rec));
+    TEST_ASSERT_NOT_NULL(q);
+    for (int i = 0; i < 10; i++) {
+        in.id = i;
+        snprintf(in.tag, sizeof(in.tag), "rec-%d", i);
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_copy(q, &in));
+        if (i >= 1) {
+            TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_copy(q, &out));
+            TEST_ASSERT_EQUAL_INT(i - 1, out.id);
+        }
+    }
+    in.id = 42;
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, try_enqueue(q, &in));
+    TEST_ASSERT_NULL(dequeue(q));
+    queue_shutdown(q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, enqueue_copy(q, &in));
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_copy(q, &out));
+    TEST_ASSERT_EQUAL_INT(9, out.id);
+    TEST_ASSERT_EQUAL_STRING("rec-9", out.tag);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, dequeue_copy(q, &out));
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+
+    queue_t ptrs = queue_init(2);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, enqueue_copy(ptrs, &in));
+    queue_destroy(ptrs);
+}
+
+/**
+ * @brief Reserved and peeked spans split at the end of the ring, publish
+ *        or consume only what is committed or released, and work the same
+ *        on a pointer SPSC ring.
+ */
+void test_reserve_commit_peek_release_wrap(void) {
+    queue_t q = queue_init_sized(4, sizeof(int));
+    queue_span_t span;
+    int v = 0;
+    for (int i = 0; i < 3; i++) {
+        enqueue_copy(q, &i);
+        dequeue_copy(q, &v);
+    }
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_reserve(q, 3, &span));
+    TEST_ASSERT_EQUAL_INT(1, span.first_len);
+    TEST_ASSERT_EQUAL_INT(2, span.second_len);
+    ((int *)span.first)[0] = 10;
+    ((int *)span.second)[0] = 11;
+    ((int *)span.second)[1] = 12;
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_commit(q, 3));
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_peek_span(q, 8, &span));
+    TEST_ASSERT_EQUAL_INT(1, span.first_len);
+    TEST_ASSERT_EQUAL_INT(2, span.second_len);
+    TEST_ASSERT_EQUAL_INT(10, ((int *)span.first)[0]);
+    TEST_ASSERT_EQUAL_INT(12, ((int *)span.second)[1]);
+    queue_release(q, 2);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_copy(q, &v));
+    TEST_ASSERT_EQUAL_INT(12, v);
+    // Only the committed part of a reservation is published.
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_reserve(q, 4, &span));
+    ((int *)span.first)[0] = 20;
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_commit(q, 1));
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_copy(q, &v));
+    TEST_ASSERT_EQUAL_INT(20, v);
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+
+    int items[3] = {1, 2, 3};
+    q = queue_init_spsc(2);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_reserve(q, 2, &span));
+    TEST_ASSERT_EQUAL_INT(QUEUE_BUSY, queue_reserve(q, 1, &span));
+    ((void **)span.first)[0] = &items[0];
+    ((void **)span.first)[1] = &items[1];
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_commit(q, 2));
+    TEST_ASSERT_EQUAL_PTR(&items[0], dequeue(q));
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_reserve(q, 1, &span));
+    ((void **)span.first)[0] = &items[2];
+    queue_commit(q, 1);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_peek_span(q, 2, &span));
+    TEST_ASSERT_EQUAL_INT(1, span.first_len);
+    TEST_ASSERT_EQUAL_INT(1, span.second_len);
+    TEST_ASSERT_EQUAL_PTR(&items[1], ((void **)span.first)[0]);
+    TEST_ASSERT_EQUAL_PTR(&items[2], ((void **)span.second)[0]);
+    queue_release(q, 2);
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+
+    q = queue_init_mpmc(2);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, queue_reserve(q, 1, &span));
+    queue_destroy(q);
+}
+
+static void *reserving_producer(void *arg) {
+    int *items = arg;
+    queue_span_t span;
+    for (int i = 0; i < MPMC_ITEMS; i += 4) {
+        if (queue_reserve(mpmc_queue, 4, &span) != QUEUE_OK) {
+            break;
+        }
+        for (int j = 0; j < 4; j++) {
+            items[i + j] = i + j;
+            void **slot = j < span.first_len ? (void **)span.first + j
+                                             : (void **)span.second + (j - span.first_len);
+            *slot = &items[i + j];
+        }
+        queue_commit(mpmc_queue, 4);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Producers that reserve concurrently, mixed with plain producers,
+ *        lose no item and publish each reservation as one FIFO run.
+ */
+void test_concurrent_reservations(void) {
+    pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+    long sums[MPMC_THREADS] = {0};
+    mpmc_queue = queue_init(6);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+        pthread_create(&producers[i], NULL, i % 2 ? reserving_producer : mpmc_producer,
+                       mpmc_items[i]);
+    }
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    queue_shutdown(mpmc_queue);
+    long total = 0;
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(consumers[i], NULL);
+        total += sums[i];
+    }
+    TEST_ASSERT_EQUAL_INT64((long)MPMC_THREADS * MPMC_ITEMS * (MPMC_ITEMS - 1) / 2, total);
+    queue_destroy(mpmc_queue);
+}
+
+static void *reserve_once(void *arg) {
+    queue_span_t span;
+    return (void *)(long)queue_reserve(arg, 1, &span);
+}
+
+/**
+ * @brief Shutdown during a pending reservation wakes the producers queued
+ *        behind it and discards the reservation at commit.
+ */
+void test_shutdown_interrupts_reservation(void) {
+    queue_t q = queue_init(2);
+    queue_span_t span;
+    int a = 1;
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_reserve(q, 2, &span));
+    ((void **)span.first)[0] = &a;
+    TEST_ASSERT_EQUAL_INT(QUEUE_BUSY, try_enqueue(q, &a));
+    pthread_t waiter, stopper;
+    pthread_create(&waiter, NULL, reserve_once, q);
+    pthread_create(&stopper, NULL, shutdown_after_delay, q);
+    void *status = NULL;
+    pthread_join(waiter, &status);
+    pthread_join(stopper, NULL);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, (int)(long)status);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, queue_commit(q, 1));
+    TEST_ASSERT_TRUE(is_empty(q));
+    TEST_ASSERT_NULL(dequeue(q));
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, queue_peek_span(q, 1, &span));
+    queue_destroy(q);
+}
+
+/**
+ * @brief A mirrored ring hands out unsplit spans and batches across the
+ *        wrap point; rings that are not page-sized keep the normal layout.
+ */
+void test_mirrored_ring_contiguous_wrap(void) {
+    int cap = (int)(sysconf(_SC_PAGESIZE) / sizeof(void *));
+    queue_t small = queue_init(5);
+    TEST_ASSERT_FALSE(queue_set_mirrored(small));
+    queue_destroy(small);
+    queue_t mpmc = queue_init_mpmc(cap);
+    TEST_ASSERT_FALSE(queue_set_mirrored(mpmc));
+    queue_destroy(mpmc);
+
+    static int items[8];
+    void *out[8];
+    queue_t (*inits[])(int) = {queue_init, queue_init_spsc};
+    for (size_t k = 0; k < sizeof(inits) / sizeof(inits[0]); k++) {
+        queue_t q = inits[k](cap);
+        TEST_ASSERT_TRUE(queue_set_mirrored(q));
+        // Move head and tail to two slots before the end of the ring.
+        for (int i = 0; i < cap - 2; i++) {
+            enqueue(q, &items[0]);
+            dequeue(q);
+        }
+        queue_span_t span;
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_reserve(q, 4, &span));
+        TEST_ASSERT_EQUAL_INT(4, span.first_len);
+        TEST_ASSERT_NULL(span.second);
+        for (int i = 0; i < 4; i++) {
+            ((void **)span.first)[i] = &items[i];
+        }
+        queue_commit(q, 4);
+        void *more[4] = {&items[4], &items[5], &items[6], &items[7]};
+        TEST_ASSERT_EQUAL_INT(4, enqueue_batch(q, more, 4));
+        TEST_ASSERT_EQUAL_INT(8, dequeue_batch(q, out, 8, 8));
+        for (int i = 0; i < 8; i++) {
+            TEST_ASSERT_EQUAL_PTR(&items[i], out[i]);
+        }
+        queue_destroy(q);
+    }
+}
+
+/**
+ * @brief A huge lazy queue only keeps the pages its items occupy resident
+ *        and returns them once it drains.
+ */
+void test_lazy_queue_commits_and_returns_pages(void) {
+    const int capacity = 16 * 1024 * 1024;
+    const int burst = 256 * 1024;
+    static int item;
+    queue_stats_t stats;
+    queue_t q = queue_init_lazy(capacity);
+    TEST_ASSERT_NOT_NULL(q);
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_INT(capacity, stats.capacity);
+    TEST_ASSERT_EQUAL_UINT64((size_t)capacity * sizeof(void *), stats.ring_bytes);
+    TEST_ASSERT_LESS_THAN_UINT64(64 * 1024, stats.resident_bytes);
+    for (int i = 0; i < burst; i++) {
+        enqueue(q, &item);
+    }
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_INT(burst, stats.count);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT64((size_t)burst * sizeof(void *), stats.resident_bytes);
+    for (int i = 0; i < burst; i++) {
+        TEST_ASSERT_EQUAL_PTR(&item, dequeue(q));
+    }
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_INT(0, stats.count);
+    TEST_ASSERT_LESS_THAN_UINT64(64 * 1024, stats.resident_bytes);
+    // The ring keeps working from where head stopped.
+    enqueue(q, &item);
+    TEST_ASSERT_EQUAL_PTR(&item, dequeue(q));
+    queue_destroy(q);
+}
+
+/**
+ * @brief Placed queues work with huge pages and NUMA policies the kernel
+ *        accepts and fail cleanly for nodes that do not exist.
+ */
+void test_placed_queue_policies(void) {
+    queue_placement_t bind = {true, QUEUE_NUMA_BIND, 0};
+    queue_placement_t interleave = {false, QUEUE_NUMA_INTERLEAVE, 0};
+    queue_placement_t missing = {false, QUEUE_NUMA_BIND, 1000};
+    const queue_placement_t *ok[] = {&bind, &interleave, NULL};
+    int items[3] = {1, 2, 3};
+    for (size_t k = 0; k < sizeof(ok) / sizeof(ok[0]); k++) {
+        errno = 0;
+        queue_t q = queue_init_placed(2, ok[k]);
+        if (q == NULL && errno == ENOSYS) {
+            TEST_IGNORE_MESSAGE("kernel built without NUMA support");
+        }
+        TEST_ASSERT_NOT_NULL(q);
+        for (int i = 0; i < 3; i++) {
+            enqueue(q, &items[i]);
+            TEST_ASSERT_EQUAL_PTR(&items[i], dequeue(q));
+        }
+        queue_destroy(q);
+    }
+    TEST_ASSERT_NULL(queue_init_placed(2, &missing));
+}
+
+void test_queue_attr_init(void) {
+    queue_attr_t attr;
+    queue_stats_t stats;
+    queue_wait_strategy_t negative = {-1, 0, false};
+    queue_placement_t bad_node = {false, QUEUE_NUMA_BIND, -1};
+    int items[3] = {1, 2, 3};
+    void *out = NULL;
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_init(NULL));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_init(&attr));
+    // Invalid values are refused and leave the attributes unchanged.
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_setcapacity(&attr, 0));
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_setbackend(&attr, (queue_backend_t)42));
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_setwaitstrategy(&attr, &negative));
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_setplacement(&attr, &bad_node));
+    TEST_ASSERT_NULL(queue_init_attr(&attr)); // No capacity yet.
+    TEST_ASSERT_NULL(queue_init_attr(NULL));
+    // An MPMC queue rounded up to a power of two.
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setcapacity(&attr, 3));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setbackend(&attr, QUEUE_BACKEND_MPMC));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setpow2(&attr, true));
+    queue_t q = queue_init_attr(&attr);
+    TEST_ASSERT_NOT_NULL(q);
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_INT(4, stats.capacity);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[i % 3]));
+    }
+    TEST_ASSERT_EQUAL_INT(QUEUE_FULL, try_enqueue(q, &items[0]));
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+    TEST_ASSERT_EQUAL_PTR(&items[0], out);
+    queue_destroy(q);
+    // Options no lock-free backend implements.
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setelemsize(&attr, sizeof(int)));
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setelemsize(&attr, 0));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setparking(&attr, QUEUE_PARK_FUTEX));
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    // A sized futex queue on the mutex backend refuses the pointer calls.
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setbackend(&attr, QUEUE_BACKEND_MUTEX));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setelemsize(&attr, sizeof(int)));
+    q = queue_init_attr(&attr);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, try_enqueue(q, &items[0]));
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_copy(q, &items[2]));
+    int value = 0;
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_copy(q, &value));
+    TEST_ASSERT_EQUAL_INT(3, value);
+    queue_destroy(q);
+    // Mirroring needs a ring of its own that nothing else maps.
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setmirrored(&attr, true));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setlazy(&attr, true));
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_destroy(&attr));
+}
+
+void test_queue_init_in_place(void) {
+    size_t size = queue_required_size(4);
+    int items[5] = {1, 2, 3, 4, 5};
+    TEST_ASSERT_EQUAL_size_t(0, queue_required_size(0));
+    TEST_ASSERT_TRUE(size > 4 * sizeof(void *));
+    // Start off a cache line so the queue has to align itself.
+    unsigned char *block = malloc(size + 1);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_NULL(queue_init_in_place(block + 1, size - 1, 4));
+    TEST_ASSERT_NULL(queue_init_in_place(NULL, size, 4));
+    for (int round = 0; round < 3; round++) {
+        queue_t q = queue_init_in_place(block + 1, size, 4);
+        TEST_ASSERT_NOT_NULL(q);
+        TEST_ASSERT_TRUE((unsigned char *)q >= block + 1);
+        for (int i = 0; i < 4; i++) {
+            enqueue(q, &items[i]);
+        }
+        TEST_ASSERT_EQUAL_INT(QUEUE_FULL, try_enqueue(q, &items[4]));
+        for (int i = 0; i < 4; i++) {
+            TEST_ASSERT_EQUAL_PTR(&items[i], dequeue(q));
+        }
+        queue_destroy(q); // Leaves block to us; ASan flags a stray free.
+    }
+    free(block);
+}
+
+/**
+ * @brief Compact queues block and wake through the global parking lot:
+ *        a tiny ring passes every item between several producers and
+ *        consumers, and shutdown releases consumers parked on it.
+ */
+void test_compact_queue_parking_lot(void) {
+    pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+    long sums[MPMC_THREADS] = {0};
+    queue_stats_t stats;
+    mpmc_queue = queue_init_compact(2);
+    TEST_ASSERT_NOT_NULL(mpmc_queue);
+    queue_stats(mpmc_queue, &stats);
+    TEST_ASSERT_EQUAL_INT(2, stats.capacity);
+    TEST_ASSERT_EQUAL_size_t(2 * sizeof(void *), stats.ring_bytes);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+        pthread_create(&producers[i], NULL, mpmc_producer, mpmc_items[i]);
+    }
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    queue_shutdown(mpmc_queue);
+    long total = 0;
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(consumers[i], NULL);
+        total += sums[i];
+    }
+    TEST_ASSERT_EQUAL_INT64((long)MPMC_THREADS * MPMC_ITEMS * (MPMC_ITEMS - 1) / 2, total);
+    TEST_ASSERT_TRUE(is_shutdown(mpmc_queue));
+    queue_destroy(mpmc_queue);
+
+    queue_t q = queue_init_compact(1);
+    pthread_t t;
+    void *out = NULL;
+    queue_span_t span;
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, queue_reserve(q, 1, &span));
+    pthread_create(&t, NULL, shutdown_after_delay, q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, dequeue_timeout(q, &out, 10000));
+    pthread_join(t, NULL);
+    queue_destroy(q);
+}
+
+struct evictions {
+    atomic_int count;
+    atomic_long sum;
+};
+
+static void count_eviction(void *item, void *arg) {
+    struct evictions *e = arg;
+    atomic_fetch_add(&e->count, 1);
+    atomic_fetch_add(&e->sum, *(int *)item);
+}
+
+static queue_t overflow_queue(queue_backend_t backend, int capacity, queue_overflow_t policy,
+                              struct evictions *e) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setbackend(&attr, backend);
+    queue_attr_setoverflow(&attr, policy, count_eviction, e);
+    queue_t q = queue_init_attr(&attr);
+    queue_attr_destroy(&attr);
+    return q;
+}
+
+/**
+ * @brief A full queue refuses new items under QUEUE_OVERFLOW_REJECT and
+ *        drops its oldest ones under QUEUE_OVERFLOW_EVICT, counting both in
+ *        the stats; unsupported combinations are refused at creation.
+ */
+void test_overflow_reject_and_evict(void) {
+    static int items[6] = {0, 1, 2, 3, 4, 5};
+    queue_backend_t backends[] = {QUEUE_BACKEND_MUTEX, QUEUE_BACKEND_SPSC, QUEUE_BACKEND_MPMC};
+    queue_stats_t stats;
+    void *out = NULL;
+    for (int b = 0; b < 3; b++) {
+        queue_t q = overflow_queue(backends[b], 4, QUEUE_OVERFLOW_REJECT, NULL);
+        TEST_ASSERT_NOT_NULL(q);
+        for (int i = 0; i < 4; i++) {
+            TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_until(q, &items[i], NULL));
+        }
+        TEST_ASSERT_EQUAL_INT(QUEUE_FULL, enqueue_until(q, &items[4], NULL));
+        TEST_ASSERT_EQUAL_INT(QUEUE_FULL, try_enqueue(q, &items[4]));
+        void *batch[2] = {&items[4], &items[5]};
+        TEST_ASSERT_EQUAL_INT(0, enqueue_batch(q, batch, 2));
+        queue_stats(q, &stats);
+        TEST_ASSERT_EQUAL_size_t(4, stats.rejected);
+        TEST_ASSERT_EQUAL_size_t(0, stats.evicted);
+        for (int i = 0; i < 4; i++) {
+            TEST_ASSERT_EQUAL_PTR(&items[i], dequeue(q));
+        }
+        queue_destroy(q);
+    }
+
+    // REJECT never waits for room a reservation holds, nor to reserve.
+    for (int b = 0; b < 2; b++) {
+        queue_t q = overflow_queue(backends[b], 4, QUEUE_OVERFLOW_REJECT, NULL);
+        queue_span_t span;
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_until(q, &items[0], NULL));
+        TEST_ASSERT_EQUAL_INT(QUEUE_FULL, queue_reserve(q, 4, &span));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_reserve(q, 2, &span));
+        if (backends[b] == QUEUE_BACKEND_MUTEX) {
+            TEST_ASSERT_EQUAL_INT(QUEUE_FULL, enqueue_until(q, &items[1], NULL));
+            void *batch[1] = {&items[1]};
+            TEST_ASSERT_EQUAL_INT(0, enqueue_batch(q, batch, 1));
+            TEST_ASSERT_EQUAL_INT(QUEUE_FULL, queue_reserve(q, 1, &span));
+            queue_stats(q, &stats);
+            TEST_ASSERT_EQUAL_size_t(2, stats.rejected);
+        }
+        ((void **)span.first)[0] = &items[2];
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, queue_commit(q, 1));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_until(q, &items[3], NULL));
+        TEST_ASSERT_EQUAL_PTR(&items[0], dequeue(q));
+        TEST_ASSERT_EQUAL_PTR(&items[2], dequeue(q));
+        TEST_ASSERT_EQUAL_PTR(&items[3], dequeue(q));
+        queue_destroy(q);
+    }
+
+    queue_backend_t evicting[] = {QUEUE_BACKEND_MUTEX, QUEUE_BACKEND_MPMC};
+    for (int b = 0; b < 2; b++) {
+        struct evictions e = {0};
+        queue_t q = overflow_queue(evicting[b], 4, QUEUE_OVERFLOW_EVICT, &e);
+        TEST_ASSERT_NOT_NULL(q);
+        for (int i = 0; i < 6; i++) {
+            TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[i]));
+        }
+        TEST_ASSERT_EQUAL_INT(2, e.count);
+        TEST_ASSERT_EQUAL_INT64(0 + 1, e.sum);
+        queue_stats(q, &stats);
+        TEST_ASSERT_EQUAL_size_t(2, stats.evicted);
+        TEST_ASSERT_EQUAL_INT(4, stats.count);
+        // A batch larger than the ring keeps only its newest items.
+        void *batch[6] = {&items[0], &items[1], &items[2], &items[3], &items[4], &items[5]};
+        TEST_ASSERT_EQUAL_INT(6, enqueue_batch(q, batch, 6));
+        TEST_ASSERT_EQUAL_INT(8, e.count);
+        for (int i = 2; i < 6; i++) {
+            TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+            TEST_ASSERT_EQUAL_PTR(&items[i], out);
+        }
+        TEST_ASSERT_EQUAL_INT(QUEUE_EMPTY, try_dequeue(q, &out));
+        queue_destroy(q);
+    }
+
+    // Sized queues hand the callback the element itself.
+    struct evictions e = {0};
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, 2);
+    queue_attr_setelemsize(&attr, sizeof(int));
+    queue_attr_setoverflow(&attr, QUEUE_OVERFLOW_EVICT, count_eviction, &e);
+    queue_t q = queue_init_attr(&attr);
+    TEST_ASSERT_NOT_NULL(q);
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_copy(q, &i));
+    }
+    TEST_ASSERT_EQUAL_INT(3, e.count);
+    TEST_ASSERT_EQUAL_INT64(0 + 1 + 2, e.sum);
+    for (int i = 3; i < 5; i++) {
+        int elem = -1;
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_copy(q, &elem));
+        TEST_ASSERT_EQUAL_INT(i, elem);
+    }
+    queue_destroy(q);
+
+    TEST_ASSERT_NULL(overflow_queue(QUEUE_BACKEND_SPSC, 4, QUEUE_OVERFLOW_EVICT, NULL));
+    TEST_ASSERT_NULL(overflow_queue(QUEUE_BACKEND_MUTEX, 4, QUEUE_OVERFLOW_OVERWRITE, NULL));
+    TEST_ASSERT_NULL(overflow_queue(QUEUE_BACKEND_COMPACT, 4, QUEUE_OVERFLOW_REJECT, NULL));
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_setoverflow(&attr, (queue_overflow_t)42, NULL, NULL));
+    queue_attr_destroy(&attr);
+}
+
+/**
+ * @brief The lossy ring keeps the newest capacity items and evicts the
+ *        rest; under contention every item is either dequeued or evicted,
+ *        exactly once.
+ */
+void test_overwrite_ring(void) {
+    static int items[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    struct evictions e = {0};
+    void *out = NULL;
+    queue_t q = overflow_queue(QUEUE_BACKEND_MPMC, 4, QUEUE_OVERFLOW_OVERWRITE, &e);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, dequeue_timeout(q, &out, 10));
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[i]));
+    }
+    TEST_ASSERT_EQUAL_INT(6, e.count);
+    TEST_ASSERT_EQUAL_INT64(0 + 1 + 2 + 3 + 4 + 5, e.sum);
+    for (int i = 6; i < 10; i++) {
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+        TEST_ASSERT_EQUAL_PTR(&items[i], out);
+    }
+    TEST_ASSERT_EQUAL_INT(QUEUE_EMPTY, try_dequeue(q, &out));
+    queue_stats_t stats;
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_size_t(6, stats.evicted);
+    pthread_t t;
+    pthread_create(&t, NULL, shutdown_after_delay, q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, dequeue_timeout(q, &out, 10000));
+    pthread_join(t, NULL);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, try_enqueue(q, &items[0]));
+    queue_destroy(q);
+
+    // Items still in the cells at destroy are evicted, not leaked.
+    struct evictions left = {0};
+    q = overflow_queue(QUEUE_BACKEND_MPMC, 4, QUEUE_OVERFLOW_OVERWRITE, &left);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[i]));
+    }
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+    TEST_ASSERT_EQUAL_PTR(&items[0], out);
+    queue_destroy(q);
+    TEST_ASSERT_EQUAL_INT(2, left.count);
+    TEST_ASSERT_EQUAL_INT64(1 + 2, left.sum);
+
+    pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+    long sums[MPMC_THREADS] = {0};
+    struct evictions lost = {0};
+    mpmc_queue = overflow_queue(QUEUE_BACKEND_MPMC, 8, QUEUE_OVERFLOW_OVERWRITE, &lost);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+        pthread_create(&producers[i], NULL, mpmc_producer, mpmc_items[i]);
+    }
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    queue_shutdown(mpmc_queue);
+    long total = lost.sum;
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(consumers[i], NULL);
+        total += sums[i];
+    }
+    TEST_ASSERT_EQUAL_INT64((long)MPMC_THREADS * MPMC_ITEMS * (MPMC_ITEMS - 1) / 2, total);
+    queue_destroy(mpmc_queue);
+}
+
+static queue_t bytes_queue(int capacity, size_t max_bytes, queue_overflow_t policy,
+                           struct evictions *e) {
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, capacity);
+    queue_attr_setmaxbytes(&attr, max_bytes);
+    queue_attr_setoverflow(&attr, policy, count_eviction, e);
+    queue_t q = queue_init_attr(&attr);
+    queue_attr_destroy(&attr);
+    return q;
+}
+
+static void *enqueue_ninety_bytes(void *arg) {
+    static int item = 90;
+    enqueue_bytes(arg, &item, 90, NULL);
+    return NULL;
+}
+
+/**
+ * @brief A byte budget blocks producers by the size of their items as well
+ *        as by count, admits an oversized item into an empty queue, and
+ *        drives the overflow policies; stats track current and peak bytes.
+ */
+void test_byte_bounded_queue(void) {
+    static int items[4] = {0, 1, 2, 3};
+    struct timespec past = {0, 0};
+    queue_stats_t stats;
+    void *out = NULL;
+    size_t bytes = 0;
+    queue_t q = bytes_queue(8, 100, QUEUE_OVERFLOW_BLOCK, NULL);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_bytes(q, &items[0], 40, NULL));
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_bytes(q, &items[1], 40, NULL));
+    TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, enqueue_bytes(q, &items[2], 40, &past));
+    // Plain enqueue counts as 0 bytes.
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[2]));
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_size_t(80, stats.bytes);
+    TEST_ASSERT_EQUAL_INT(3, stats.count);
+
+    // A producer that needs 90 bytes waits for both 40 byte items to go.
+    pthread_t t;
+    pthread_create(&t, NULL, enqueue_ninety_bytes, q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_bytes(q, &out, &bytes, NULL));
+    TEST_ASSERT_EQUAL_PTR(&items[0], out);
+    TEST_ASSERT_EQUAL_size_t(40, bytes);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_bytes(q, &out, &bytes, NULL));
+    TEST_ASSERT_EQUAL_size_t(40, bytes);
+    pthread_join(t, NULL);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_bytes(q, &out, &bytes, NULL));
+    TEST_ASSERT_EQUAL_PTR(&items[2], out);
+    TEST_ASSERT_EQUAL_size_t(0, bytes);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_bytes(q, &out, &bytes, NULL));
+    TEST_ASSERT_EQUAL_size_t(90, bytes);
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_size_t(0, stats.bytes);
+    TEST_ASSERT_EQUAL_size_t(90, stats.peak_bytes);
+
+    // An item larger than the budget gets in once the queue is empty.
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_bytes(q, &items[3], 500, &past));
+    TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, enqueue_bytes(q, &items[0], 1, &past));
+    queue_span_t span;
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, queue_reserve(q, 1, &span));
+    queue_destroy(q);
+
+    q = bytes_queue(8, 100, QUEUE_OVERFLOW_REJECT, NULL);
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_bytes(q, &items[0], 60, NULL));
+    TEST_ASSERT_EQUAL_INT(QUEUE_FULL, enqueue_bytes(q, &items[1], 60, NULL));
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_size_t(1, stats.rejected);
+    queue_destroy(q);
+
+    // Eviction drops the oldest items until the new one fits.
+    struct evictions e = {0};
+    q = bytes_queue(8, 100, QUEUE_OVERFLOW_EVICT, &e);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_bytes(q, &items[i], 30, NULL));
+    }
+    TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_bytes(q, &items[3], 70, NULL));
+    TEST_ASSERT_EQUAL_INT(2, e.count);
+    TEST_ASSERT_EQUAL_INT64(0 + 1, e.sum);
+    queue_stats(q, &stats);
+    TEST_ASSERT_EQUAL_size_t(100, stats.bytes);
+    TEST_ASSERT_EQUAL_size_t(2, stats.evicted);
+    void *batch[2];
+    TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, batch, 2, 2));
+    TEST_ASSERT_EQUAL_PTR(&items[2], batch[0]);
+    TEST_ASSERT_EQUAL_PTR(&items[3], batch[1]);
+    queue_destroy(q);
+
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, 4);
+    queue_attr_setmaxbytes(&attr, 100);
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_SPSC);
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_MUTEX);
+    queue_attr_setelemsize(&attr, sizeof(int));
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    queue_attr_destroy(&attr);
+}
+
+static void *enqueue_after_delay(void *arg) {
+    static int item = 7;
+    struct timespec delay = {0, 10 * 1000000L};
+    nanosleep(&delay, NULL);
+    enqueue(arg, &item);
+    return NULL;
+}
+
+/**
+ * @brief Queues created with stats count items in and out, waits and the
+ *        time spent in them, peak occupancy and time in queue, on every
+ *        backend that keeps them; others report no stats block.
+ */
+void test_stats_snapshot(void) {
+    static int items[4] = {0, 1, 2, 3};
+    queue_backend_t backends[] = {QUEUE_BACKEND_MUTEX, QUEUE_BACKEND_SPSC, QUEUE_BACKEND_MPMC};
+    queue_snapshot_t snap;
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, 4);
+    queue_attr_setstats(&attr, true);
+    for (int b = 0; b < 3; b++) {
+        queue_attr_setbackend(&attr, backends[b]);
+        queue_t q = queue_init_attr(&attr);
+        TEST_ASSERT_NOT_NULL(q);
+        void *out = NULL;
+        void *batch[3];
+        for (int i = 0; i < 3; i++) {
+            TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_enqueue(q, &items[i]));
+        }
+        TEST_ASSERT_EQUAL_INT(3, dequeue_batch(q, batch, 3, 3));
+        TEST_ASSERT_EQUAL_INT(2, enqueue_batch(q, (void **)batch, 2));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, try_dequeue(q, &out));
+        TEST_ASSERT_EQUAL_INT(QUEUE_EMPTY, try_dequeue(q, &out));
+
+        // Blocks on the empty queue until the other thread enqueues.
+        pthread_t t;
+        pthread_create(&t, NULL, enqueue_after_delay, q);
+        TEST_ASSERT_NOT_NULL(dequeue(q));
+        pthread_join(t, NULL);
+
+        TEST_ASSERT_TRUE(queue_stats_snapshot(q, &snap));
+        TEST_ASSERT_EQUAL_size_t(6, snap.enqueued);
+        TEST_ASSERT_EQUAL_size_t(6, snap.dequeued);
+        TEST_ASSERT_EQUAL_size_t(0, snap.full_waits);
+        TEST_ASSERT_EQUAL_size_t(1, snap.empty_waits);
+        TEST_ASSERT_TRUE(snap.dequeue_wait_ns >= 5 * 1000000ULL);
+        TEST_ASSERT_EQUAL_INT(3, snap.peak_count);
+        size_t timed = 0;
+        for (int i = 0; i < QUEUE_LATENCY_BUCKETS; i++) {
+            timed += snap.latency[i];
+        }
+        TEST_ASSERT_EQUAL_size_t(6, timed);
+        TEST_ASSERT_TRUE(queue_latency_percentile(&snap, 100) > 0);
+        queue_destroy(q);
+    }
+
+    // The buckets are exact below 8 ns, then 8 per power of two.
+    TEST_ASSERT_EQUAL_UINT64(7, queue_latency_bucket_ns(7));
+    TEST_ASSERT_EQUAL_UINT64(8, queue_latency_bucket_ns(8));
+    TEST_ASSERT_EQUAL_UINT64(16, queue_latency_bucket_ns(16));
+    TEST_ASSERT_EQUAL_UINT64(18, queue_latency_bucket_ns(17));
+    for (int i = 1; i < QUEUE_LATENCY_BUCKETS; i++) {
+        TEST_ASSERT_TRUE(queue_latency_bucket_ns(i) > queue_latency_bucket_ns(i - 1));
+    }
+    memset(&snap, 0, sizeof(snap));
+    snap.latency[16] = 9;
+    snap.latency[20] = 1;
+    TEST_ASSERT_EQUAL_UINT64(18, queue_latency_percentile(&snap, 50));
+    TEST_ASSERT_EQUAL_UINT64(queue_latency_bucket_ns(21), queue_latency_percentile(&snap, 100));
+
+    queue_t plain = queue_init(4);
+    TEST_ASSERT_FALSE(queue_stats_snapshot(plain, &snap));
+    TEST_ASSERT_EQUAL_size_t(0, snap.enqueued);
+    queue_destroy(plain);
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_COMPACT);
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    queue_attr_setbackend(&attr, QUEUE_BACKEND_MPMC);
+    queue_attr_setoverflow(&attr, QUEUE_OVERFLOW_OVERWRITE, NULL, NULL);
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    queue_attr_destroy(&attr);
+}
+
+/**
+ * @brief A named queue publishes its counters in this process's registry,
+ *        where a read-only mapping sees them change, and leaves it when
+ *        destroyed.
+ */
+void test_registry_publishes_named_queue(void) {
+    static int items[2] = {0, 1};
+    queue_registry_entry_t entries[8];
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    queue_attr_setcapacity(&attr, 4);
+    char long_name[QUEUE_NAME_MAX + 1];
+    memset(long_name, 'x', QUEUE_NAME_MAX);
+    long_name[QUEUE_NAME_MAX] = '\0';
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_setname(&attr, long_name));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setname(&attr, "test-registry"));
+    queue_t q = queue_init_attr(&attr);
+    TEST_ASSERT_NOT_NULL(q);
+
+    int pids[64];
+    int n = queue_registry_list(pids, 64);
+    bool listed = false;
+    for (int i = 0; i < n; i++) {
+        listed = listed || pids[i] == getpid();
+    }
+    TEST_ASSERT_TRUE(listed);
+    queue_registry_t reg = queue_registry_open(getpid());
+    TEST_ASSERT_NOT_NULL(reg);
+    TEST_ASSERT_EQUAL_INT(1, queue_registry_read(reg, entries, 8));
+    TEST_ASSERT_EQUAL_STRING("test-registry", entries[0].name);
+    TEST_ASSERT_EQUAL_INT(4, entries[0].capacity);
+    TEST_ASSERT_EQUAL_INT(QUEUE_BACKEND_MUTEX, entries[0].backend);
+    TEST_ASSERT_EQUAL_size_t(0, entries[0].stats.enqueued);
+
+    enqueue(q, &items[0]);
+    enqueue(q, &items[1]);
+    TEST_ASSERT_EQUAL_PTR(&items[0], dequeue(q));
+    TEST_ASSERT_EQUAL_INT(1, queue_registry_read(reg, entries, 8));
+    TEST_ASSERT_EQUAL_size_t(2, entries[0].stats.enqueued);
+    TEST_ASSERT_EQUAL_size_t(1, entries[0].stats.dequeued);
+    TEST_ASSERT_EQUAL_INT(2, entries[0].stats.peak_count);
+    // The queue reads the same counters the registry shows.
+    queue_snapshot_t snap;
+    TEST_ASSERT_TRUE(queue_stats_snapshot(q, &snap));
+    TEST_ASSERT_EQUAL_size_t(2, snap.enqueued);
+
+    queue_destroy(q);
+    TEST_ASSERT_EQUAL_INT(0, queue_registry_read(reg, entries, 8));
+    queue_registry_close(reg);
+    TEST_ASSERT_NULL(queue_registry_open(-1));
+    queue_attr_destroy(&attr);
+}
+
+/**
+ * @brief Producers and consumers contend for a small mutex queue. A
+ *        lockprof build must have booked every critical section with
+ *        consistent totals; any other build reports no profile at all.
+ */
+void test_lock_profile(void) {
+    queue_lock_stats_t sites[QUEUE_LOCK_SITES];
+    TEST_ASSERT_FALSE(queue_lock_profile(NULL, sites));
+    pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+    long sums[MPMC_THREADS] = {0};
+    mpmc_queue = queue_init(4);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+        pthread_create(&producers[i], NULL, mpmc_producer, mpmc_items[i]);
+    }
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    queue_shutdown(mpmc_queue);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(consumers[i], NULL);
+    }
+    TEST_ASSERT_TRUE(is_empty(mpmc_queue));
+#ifdef QUEUE_LOCK_PROFILE
+    TEST_ASSERT_TRUE(queue_lock_profile(mpmc_queue, sites));
+    unsigned long long wakeups = 0;
+    for (int i = QUEUE_LOCK_ENQUEUE; i <= QUEUE_LOCK_DEQUEUE; i++) {
+        const queue_lock_stats_t *s = &sites[i];
+        // Every item took the lock once on each side, plus the final dequeues.
+        TEST_ASSERT_TRUE(s->acquires >= (unsigned long long)MPMC_THREADS * MPMC_ITEMS);
+        TEST_ASSERT_TRUE(s->contended <= s->acquires);
+        TEST_ASSERT_TRUE(s->hold_ns > 0);
+        TEST_ASSERT_TRUE(s->acquire_max_ns <= s->acquire_ns);
+        TEST_ASSERT_TRUE(s->hold_max_ns <= s->hold_ns);
+        TEST_ASSERT_TRUE(s->wake_max_ns <= s->wake_ns);
+        wakeups += s->wakeups;
+    }
+    // The consumers start on an empty queue and the producers fill it.
+    TEST_ASSERT_TRUE(wakeups > 0);
+    TEST_ASSERT_TRUE(sites[QUEUE_LOCK_IS_EMPTY].acquires >= 1);
+    TEST_ASSERT_TRUE(sites[QUEUE_LOCK_SHUTDOWN].acquires == 1);
+#else
+    TEST_ASSERT_FALSE(queue_lock_profile(mpmc_queue, sites));
+    TEST_ASSERT_TRUE(sites[QUEUE_LOCK_ENQUEUE].acquires == 0);
+#endif
+    queue_destroy(mpmc_queue);
+}
+
+/**
+ * @brief An unbounded queue takes any number of items without a consumer,
+ *        across segments, in FIFO order, keeps only the configured number
+ *        of drained segments, and still blocks consumers and honors
+ *        shutdown.
+ */
+void test_unbounded_queue(void) {
+    enum { N = 2000 }; // Several segments, the last one partly filled
+    static int items[N];
+    static void *out[N];
+    queue_stats_t stats;
+    queue_attr_t attr;
+    queue_attr_init(&attr);
+    TEST_ASSERT_EQUAL_INT(EINVAL, queue_attr_setsegmentcache(&attr, -1));
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setbackend(&attr, QUEUE_BACKEND_UNBOUNDED));
+    queue_attr_setstats(&attr, true);
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    queue_attr_setstats(&attr, false);
+    TEST_ASSERT_EQUAL_INT(0, queue_attr_setmaxbytes(&attr, 4096));
+    TEST_ASSERT_NULL(queue_init_attr(&attr));
+    queue_attr_setmaxbytes(&attr, 0);
+
+    size_t kept[2];
+    for (int cache = 0; cache < 2; cache++) {
+        queue_attr_setsegmentcache(&attr, cache == 0 ? 0 : 4);
+        queue_t q = queue_init_attr(&attr);
+        TEST_ASSERT_NOT_NULL(q);
+        void *none = NULL;
+        TEST_ASSERT_EQUAL_INT(QUEUE_EMPTY, try_dequeue(q, &none));
+        for (int i = 0; i < N; i++) {
+            items[i] = i;
+            TEST_ASSERT_EQUAL_INT(QUEUE_OK, i % 2 ? try_enqueue(q, &items[i])
+                                                  : enqueue_timeout(q, &items[i], 0));
+        }
+        queue_stats(q, &stats);
+        TEST_ASSERT_EQUAL_INT(INT_MAX, stats.capacity);
+        TEST_ASSERT_EQUAL_INT(N, stats.count);
+        TEST_ASSERT_TRUE(stats.ring_bytes >= N * sizeof(void *));
+        TEST_ASSERT_EQUAL_INT(3, dequeue_batch(q, out, 3, 1));
+        TEST_ASSERT_EQUAL_INT(N - 4, dequeue_batch(q, out + 3, N - 4, N - 4));
+        TEST_ASSERT_EQUAL_PTR(&items[N - 1], dequeue(q));
+        for (int i = 0; i < N - 1; i++) {
+            TEST_ASSERT_EQUAL_PTR(&items[i], out[i]);
+        }
+        TEST_ASSERT_TRUE(is_empty(q));
+        TEST_ASSERT_EQUAL_INT(QUEUE_TIMEOUT, dequeue_timeout(q, &none, 5));
+        queue_stats(q, &stats);
+        kept[cache] = stats.ring_bytes;
+        // Refill across the drained segments, then drain by batch.
+        out[N - 1] = &items[N - 1];
+        TEST_ASSERT_EQUAL_INT(N, enqueue_batch(q, out, N));
+        TEST_ASSERT_EQUAL_INT(N, dequeue_batch(q, out, N, N));
+        TEST_ASSERT_EQUAL_PTR(&items[0], out[0]);
+        TEST_ASSERT_EQUAL_PTR(&items[N - 1], out[N - 1]);
+        // Without a byte budget the sizes are ignored.
+        size_t bytes = 1;
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, enqueue_bytes(q, &items[0], 100, NULL));
+        TEST_ASSERT_EQUAL_INT(QUEUE_OK, dequeue_bytes(q, &none, &bytes, NULL));
+        TEST_ASSERT_EQUAL_PTR(&items[0], none);
+        TEST_ASSERT_EQUAL_size_t(0, bytes);
+        queue_destroy(q);
+    }
+    // Only the partly used tail segment survives without a cache.
+    TEST_ASSERT_TRUE(kept[0] > 0);
+    TEST_ASSERT_EQUAL_size_t(4 * kept[0], kept[1]);
+    queue_attr_destroy(&attr);
+
+    pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+    long sums[MPMC_THREADS] = {0};
+    mpmc_queue = queue_init_unbounded();
+    TEST_ASSERT_NOT_NULL(mpmc_queue);
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_create(&consumers[i], NULL, mpmc_consumer, &sums[i]);
+        pthread_create(&producers[i], NULL, mpmc_producer, mpmc_items[i]);
+    }
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    queue_shutdown(mpmc_queue);
+    long total = 0;
+    for (int i = 0; i < MPMC_THREADS; i++) {
+        pthread_join(consumers[i], NULL);
+        total += sums[i];
+    }
+    TEST_ASSERT_EQUAL_INT64((long)MPMC_THREADS * MPMC_ITEMS * (MPMC_ITEMS - 1) / 2, total);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, try_enqueue(mpmc_queue, &items[0]));
+    queue_destroy(mpmc_queue);
+
+    queue_t q = queue_init_unbounded();
+    pthread_t t;
+    void *got = NULL;
+    queue_span_t span;
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, queue_reserve(q, 1, &span));
+    TEST_ASSERT_FALSE(queue_set_mirrored(q));
+    pthread_create(&t, NULL, shutdown_after_delay, q);
+    TEST_ASSERT_EQUAL_INT(QUEUE_SHUTDOWN, dequeue_timeout(q, &got, 10000));
+    pthread_join(t, NULL);
+    queue_destroy(q);
+}
 
 int main(void) {
   UNITY_BEGIN();
@@ -235,5 +1599,36 @@ int main(void) {
   RUN_TEST(test_large_volume);
   RUN_TEST(test_enqueue_dequeue_after_wraparound);
   // RUN_TEST(test_stress_multithreaded);
+  RUN_TEST(test_spsc_fifo_and_shutdown);
+  RUN_TEST(test_spsc_threaded_order);
+  RUN_TEST(test_mpmc_fifo_and_shutdown);
+  RUN_TEST(test_mpmc_threaded_sum);
+  RUN_TEST(test_batch_wraparound);
+  RUN_TEST(test_batch_min_and_shutdown);
+  RUN_TEST(test_try_status_codes);
+  RUN_TEST(test_timed_operations_time_out);
+  RUN_TEST(test_timed_wait_interrupted_by_shutdown);
+  RUN_TEST(test_burst_wakes_every_sleeping_consumer);
+  RUN_TEST(test_futex_parking_threaded_sum);
+  RUN_TEST(test_futex_parking_timeout_and_shutdown);
+  RUN_TEST(test_adaptive_wait_strategy);
+  RUN_TEST(test_pow2_capacity_wraparound);
+  RUN_TEST(test_sized_queue_copies_elements);
+  RUN_TEST(test_reserve_commit_peek_release_wrap);
+  RUN_TEST(test_concurrent_reservations);
+  RUN_TEST(test_shutdown_interrupts_reservation);
+  RUN_TEST(test_mirrored_ring_contiguous_wrap);
+  RUN_TEST(test_lazy_queue_commits_and_returns_pages);
+  RUN_TEST(test_placed_queue_policies);
+  RUN_TEST(test_queue_attr_init);
+  RUN_TEST(test_queue_init_in_place);
+  RUN_TEST(test_compact_queue_parking_lot);
+  RUN_TEST(test_overflow_reject_and_evict);
+  RUN_TEST(test_overwrite_ring);
+  RUN_TEST(test_byte_bounded_queue);
+  RUN_TEST(test_stats_snapshot);
+  RUN_TEST(test_registry_publishes_named_queue);
+  RUN_TEST(test_lock_profile);
+  RUN_TEST(test_unbounded_queue);
   return UNITY_END();
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+/**
+ * @file queuetop.c
+ * @brief Live view of the named queues of running processes. Maps each
+ *        process's registry segment read-only and prints, per queue, the
+ *        enqueue and dequeue rates, occupancy, waits, blocked threads and
+ *        time in queue over the last refresh interval.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/lab.h"
+
+#define MAX_PIDS 64
+#define MAX_QUEUES 256
+#define DEFAULT_DELAY_MS 1000
+
+/*One queue as seen at the previous refresh, to turn counters into rates*/
+struct sample
+{
+     int pid;
+     char name[QUEUE_NAME_MAX];
+     queue_snapshot_t stats;
+};
+
+static struct sample prev[MAX_QUEUES];
+static int nprev;
+static struct sample cur[MAX_QUEUES];
+static int ncur;
+
+static double now_s(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(char *n)
+{
+     fprintf(stderr, "Usage: %s [-d delay ms] [-n refreshes] [pid ...]\n", n);
+     fprintf(stderr, "Shows the queues published with queue_attr_setname by the given processes, or by every process\n");
+     fprintf(stderr, "-d sets the refresh interval (default %d ms)\n", DEFAULT_DELAY_MS);
+     fprintf(stderr, "-n stops after that many refreshes (default: run until interrupted)\n");
+     exit(EXIT_FAILURE);
+}
+
+static const char *backend_name(queue_backend_t backend)
+{
+     switch (backend)
+     {
+     case QUEUE_BACKEND_MUTEX:
+          return "lock";
+     case QUEUE_BACKEND_SPSC:
+          return "spsc";
+     case QUEUE_BACKEND_MPMC:
+          return "mpmc";
+     default:
+          return "?";
+     }
+}
+
+/*The same queue at the previous refresh, or NULL if it is new*/
+static const struct sample *previous(int pid, const char *name)
+{
+     for (int i = 0; i < nprev; i++)
+          if (prev[i].pid == pid && strcmp(prev[i].name, name) == 0)
+               return &prev[i];
+     return NULL;
+}
+
+/*Per-second rate of a counter that went from before to after*/
+static double rate(size_t before, size_t after, double secs)
+{
+     return after >= before && secs > 0 ? (after - before) / secs : 0;
+}
+
+static void show(int pid, const queue_registry_entry_t *e, double secs)
+{
+     const queue_snapshot_t *s = &e->stats;
+     const struct sample *p = previous(pid, e->name);
+     queue_snapshot_t zero;
+     memset(&zero, 0, sizeof(zero));
+     const queue_snapshot_t *b = p != NULL ? &p->stats : &zero;
+
+     /*Time in queue of the items dequeued since the previous refresh*/
+     queue_snapshot_t window = *s;
+     for (int i = 0; i < QUEUE_LATENCY_BUCKETS; i++)
+          window.latency[i] = s->latency[i] >= b->latency[i] ? s->latency[i] - b->latency[i] : 0;
+
+     long depth = s->enqueued >= s->dequeued ? (long)(s->enqueued - s->dequeued) : 0;
+     if (depth > e->capacity)
+          depth = e->capacity;
+     printf("%7d %-20.20s %-4s %7d %7ld %7d %10.0f %10.0f %8.0f %8.0f %4d %4d %10llu\n",
+            pid, e->name, backend_name(e->backend), e->capacity, depth, s->peak_count,
+            rate(b->enqueued, s->enqueued, secs), rate(b->dequeued, s->dequeued, secs),
+            rate(b->full_waits, s->full_waits, secs), rate(b->empty_waits, s->empty_waits, secs),
+            s->blocked_producers, s->blocked_consumers, queue_latency_percentile(&window, 99));
+     if (ncur < MAX_QUEUES)
+     {
+          cur[ncur].pid = pid;
+          memcpy(cur[ncur].name, e->name, sizeof(cur[ncur].name));
+          cur[ncur].stats = *s;
+          ncur++;
+     }
+}
+
+int main(int argc, char *argv[])
+{
+     long delay_ms = DEFAULT_DELAY_MS;
+     long refreshes = -1;
+     int pids[MAX_PIDS];
+     int npids = 0;
+     int c;
+
+     while ((c = getopt(argc, argv, "d:n:h")) != -1)
+          switch (c)
+          {
+          case 'd':
+               delay_ms = atol(optarg);
+               break;
+          case 'n':
+               refreshes = atol(optarg);
+               break;
+          default:
+               usage(argv[0]);
+          }
+     if (delay_ms <= 0)
+          usage(argv[0]);
+     for (int i = optind; i < argc && npids < MAX_PIDS; i++)
+          pids[npids++] = atoi(argv[i]);
+
+     static queue_registry_entry_t entries[MAX_QUEUES];
+     bool tty = isatty(STDOUT_FILENO);
+     double last = now_s();
+     for (long round = 0; refreshes < 0 || round < refreshes; round++)
+     {
+          if (round > 0)
+          {
+               struct timespec ts = {delay_ms / 1000, delay_ms % 1000 * 1000000L};
+               nanosleep(&ts, NULL);
+          }
+          double t = now_s();
+          double secs = round > 0 ? t - last : 0;
+          last = t;
+
+          /*Without pids, whatever processes publish queues right now*/
+          int watch[MAX_PIDS];
+          int nwatch = npids > 0 ? npids : queue_registry_list(watch, MAX_PIDS);
+          if (npids > 0)
+               memcpy(watch, pids, sizeof(int) * npids);
+
+          if (tty)
+               printf("\033[H\033[2J");
+          printf("queuetop - %d process%s, refresh %ld ms\n", nwatch, nwatch == 1 ? "" : "es", delay_ms);
+          printf("%7s %-20s %-4s %7s %7s %7s %10s %10s %8s %8s %4s %4s %10s\n", "PID", "NAME", "KIND", "CAP",
+                 "DEPTH", "PEAK", "ENQ/s", "DEQ/s", "FULL/s", "EMPTY/s", "BLKP", "BLKC", "P99ns");
+          ncur = 0;
+          for (int i = 0; i < nwatch; i++)
+          {
+               /*A segment whose process died without cleaning up is stale*/
+               if (kill(watch[i], 0) != 0 && errno == ESRCH)
+                    continue;
+               queue_registry_t reg = queue_registry_open(watch[i]);
+               if (reg == NULL)
+                    continue;
+               int n = queue_registry_read(reg, entries, MAX_QUEUES);
+               queue_registry_close(reg);
+               for (int j = 0; j < n; j++)
+                    show(watch[i], &entries[j], secs);
+          }
+          memcpy(prev, cur, sizeof(cur[0]) * ncur);
+          nprev = ncur;
+          fflush(stdout);
+     }
+     return 0;
+}